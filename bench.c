@@ -0,0 +1,1213 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include "bufpool.h"
+#include "iocore.h"
+#include "membw.h"
+#include "pipeline.h"
+#include "report.h"
+#include "timing.h"
+
+#define ENGINE_SYNC 0
+#define ENGINE_URING 1
+#define ENGINE_PREADV 2   // preadv() of several blocks per call
+#define ENGINE_NOWAIT 3   // preadv2(RWF_NOWAIT) first, blocking preadv() for the rest
+
+// Settings shared by every subcommand, filled in from the command line
+struct Options {
+    const char* filename;
+    int blockSizes[MAX_LIST_VALUES];
+    int numBlockSizes;
+    int modes[MAX_LIST_VALUES];
+    int numModes;
+    int engines[MAX_LIST_VALUES];
+    int numEngines;
+    int queueDepths[MAX_LIST_VALUES];
+    int numQueueDepths;
+    struct ReadaheadPolicy readahead[MAX_LIST_VALUES];
+    int numReadahead;
+    int vectorSizes[MAX_LIST_VALUES];
+    int numVectorSizes;
+    int threads[MAX_LIST_VALUES];
+    int numThreads;
+    int strategy;
+    int chunkBlocks;
+    int affinity[MAX_LIST_VALUES];
+    int numAffinity;
+    int verify;
+    int writeModes[MAX_LIST_VALUES];
+    int numWriteModes;
+    struct SyncPolicy syncPolicies[MAX_LIST_VALUES];
+    int numSyncPolicies;
+    int preallocate[2];
+    int numPreallocate;
+    long long writeBytes;
+    struct AccessPattern patterns[MAX_LIST_VALUES];
+    int numPatterns;
+    long long numReads;
+    int numFiles;
+    int minFileSize;
+    int maxFileSize;
+    int treeDepth;
+    int recordSize;
+    long long recordsPerThread;
+    int windowUs;
+    int maxBatch;
+    int residency[MAX_LIST_VALUES];  // Percent of the file warmed before each run
+    int numResidency;
+    struct WarmLayout layouts[MAX_LIST_VALUES];
+    int numLayouts;
+    int checksums[MAX_LIST_VALUES];
+    int numChecksums;
+    int countEvents;  // Count perf events around every timed loop
+};
+
+struct Command {
+    const char* name;
+    int (*run)(const struct Options* options);
+    const char* description;
+    int creates;  // What the command creates at the path instead of reading it
+};
+
+#define CREATES_NOTHING 0
+#define CREATES_FILE 1
+#define CREATES_DIRECTORY 2
+
+int runRead(const struct Options* options);
+int runParallel(const struct Options* options);
+int runXor(const struct Options* options);
+int runPipeline(const struct Options* options);
+int runChecksum(const struct Options* options);
+int runWrite(const struct Options* options);
+int runWal(const struct Options* options);
+int runRandom(const struct Options* options);
+int runSmallFiles(const struct Options* options);
+int runResidency(const struct Options* options);
+
+const struct Command commands[] = {
+    {"read", runRead, "Sequential read sweep over block sizes, modes and engines", CREATES_NOTHING},
+    {"parallel", runParallel, "Multithreaded pread() sweep over block sizes and thread counts", CREATES_NOTHING},
+    {"random", runRandom, "pread() at block-aligned offsets from uniform, Zipf or hot-set patterns", CREATES_NOTHING},
+    {"residency", runResidency, "Sequential and random reads with part of the file warmed in the page cache",
+     CREATES_NOTHING},
+    {"smallfiles", runSmallFiles, "open+fstat+read+close over a generated tree of small files (path is the tree root)",
+     CREATES_DIRECTORY},
+    {"xor", runXor, "XOR checksum of the file", CREATES_NOTHING},
+    {"pipeline", runPipeline, "Serial read+XOR against a reader filling a ring of buffers for XOR workers",
+     CREATES_NOTHING},
+    {"checksum", runChecksum, "CRC32C and xxHash64 of the file on the streaming read path", CREATES_NOTHING},
+    {"write", runWrite, "Sequential write sweep over block sizes and durability policies (overwrites the file)", CREATES_FILE},
+    {"wal", runWal, "Group-commit log: producer threads append records, one thread batches fdatasync()", CREATES_FILE},
+};
+const int numCommands = sizeof(commands) / sizeof(commands[0]);
+
+void printUsage() {
+    printf("Usage: ./bench <command> [options] <filename>\n\n");
+    printf("Commands:\n");
+    for (int i = 0; i < numCommands; ++i) {
+        printf("  %-10s %s\n", commands[i].name, commands[i].description);
+    }
+    printf("\nOptions:\n");
+    printf("  -b sizes     Comma separated block sizes in bytes (default 512,1024,...,2400)\n");
+    printf("  -m modes     Comma separated read modes: cached, cold, direct (default cached,cold)\n");
+    printf("  -e engines   Comma separated read engines: sync, uring, preadv, nowait (default sync)\n");
+    printf("  -q depths    io_uring queue depths, or pipeline ring depths (default 1,4,16,64)\n");
+    printf("  -A policies  Readahead policies of the sync engine: kernel, sequential, random, noreuse,\n");
+    printf("               willneed, readahead[:MiB], prefetch[:MiB] (default kernel)\n");
+    printf("  -v blocks    Blocks gathered per preadv() call, at most %d (default 16)\n", IOV_MAX);
+    printf("  -t threads   Comma separated thread counts (default 4)\n");
+    printf("  -s strategy  Parallel chunking: static or dynamic (default static)\n");
+    printf("  -c blocks    Blocks per dynamic chunk (default 256)\n");
+    printf("  -C policies  Comma separated thread placements of parallel reads: none, compact, scatter\n");
+    printf("               (default none)\n");
+    printf("  -p patterns  Comma separated access patterns: sequential, uniform, zipf[:skew],\n");
+    printf("               hotset[:fraction[:probability]] (default sequential,uniform,zipf:0.99)\n");
+    printf("  -N reads     Reads per random run, split over the threads (default 100000)\n");
+    printf("  -R percents  Comma separated shares of the file warmed before a residency run\n");
+    printf("               (default 0,10,25,50,75,90,100)\n");
+    printf("  -L layouts   Comma separated warm layouts: prefix, random, striped[:KiB]\n");
+    printf("               (default prefix,random,striped:%lld)\n", WARM_DEFAULT_STRIPE / KILOBYTE);
+    printf("  -F files     Files in the small-file tree (default 10000)\n");
+    printf("  -z min:max   Small-file size range in KiB, log-uniform (default 4:64)\n");
+    printf("  -D depth     Directory levels of the small-file tree, %d subdirectories each (default 2)\n", TREE_FANOUT);
+    printf("  -w modes     Comma separated write modes: buffered, direct, dsync (default buffered)\n");
+    printf("  -y policies  Comma separated durability policies: none, fsync, fdatasync or pipeline,\n");
+    printf("               with :N to flush every N blocks (default none,fdatasync,fdatasync:64)\n");
+    printf("  -a prealloc  fallocate() before writing: off, on or off,on (default off)\n");
+    printf("  -S size      MiB to write per run (default 256)\n");
+    printf("  -r bytes     Log record size (default 128)\n");
+    printf("  -n records   Records appended per producer thread (default 2000)\n");
+    printf("  -W usec      Group-commit window after the first record of a batch (default 0)\n");
+    printf("  -B records   Records that close a batch early, 0 for no limit (default 0)\n");
+    printf("  -k engines   Comma separated checksum engines: crc32c, crc32c-sw, xxh64 (default all)\n");
+    printf("  -x           Verify the XOR checksum against the scalar reference, or hardware\n");
+    printf("               CRC32C against the table-driven one\n");
+    printf("  -P           Count cycles, instructions, cache misses, page faults, context switches and\n");
+    printf("               CPU migrations around every read and write loop\n");
+    printf("  -H pages     Pages backing every I/O buffer: 4k, thp or hugetlb (default 4k)\n");
+    printf("  -M MiB       Calibrate memory bandwidth with up to MiB of buffers first, and add each\n");
+    printf("               read's share of memcpy at its thread count (default off)\n");
+    printf("  -f format    Output format: text, json or csv (default text)\n");
+    printf("  -o file      Write results to file instead of stdout\n");
+}
+
+// parseList() callbacks, one per kind of list value
+struct NameList {
+    int* values;
+    int (*parse)(const char*);
+};
+
+int parseNameToken(const char* token, int index, void* context) {
+    struct NameList* list = context;
+    return (list->values[index] = list->parse(token)) >= 0;
+}
+
+int parseSyncPolicyToken(const char* token, int index, void* context) {
+    return parseSyncPolicy(token, (struct SyncPolicy*)context + index);
+}
+
+int parsePatternToken(const char* token, int index, void* context) {
+    return parseAccessPattern(token, (struct AccessPattern*)context + index);
+}
+
+int parseReadaheadToken(const char* token, int index, void* context) {
+    return parseReadaheadPolicy(token, (struct ReadaheadPolicy*)context + index);
+}
+
+// Percentages, 0 included
+int parsePercentToken(const char* token, int index, void* context) {
+    long long value;
+    if (!parseInteger(token, 0, 100, &value)) {
+        return 0;
+    }
+    ((int*)context)[index] = value;
+    return 1;
+}
+
+int parseLayoutToken(const char* token, int index, void* context) {
+    return parseWarmLayout(token, (struct WarmLayout*)context + index);
+}
+
+// Parses min:max in KiB for -z into bytes
+int parseSizeRange(const char* text, int* minSize, int* maxSize) {
+    const char* colon = strchr(text, ':');
+    if (colon == NULL) {
+        return 0;
+    }
+    char* first = strndup(text, colon - text);
+    if (first == NULL) {
+        perror("Error allocating buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    long long low, high;
+    int ok = parseInteger(first, 1, 1024 * 1024, &low) && parseInteger(colon + 1, 1, 1024 * 1024, &high) &&
+             high >= low;
+    free(first);
+    if (ok) {
+        *minSize = low * KILOBYTE;
+        *maxSize = high * KILOBYTE;
+    }
+    return ok;
+}
+
+// Parses a comma separated list of names with the given parser
+int parseNameList(const char* list, int* values, int maxValues, int (*parse)(const char*)) {
+    struct NameList context = {values, parse};
+    return parseList(list, maxValues, parseNameToken, &context);
+}
+
+int parseSwitch(const char* name) {
+    if (strcmp(name, "off") == 0) {
+        return 0;
+    }
+    if (strcmp(name, "on") == 0) {
+        return 1;
+    }
+    return -1;
+}
+
+int parseEngine(const char* name) {
+    if (strcmp(name, "sync") == 0) {
+        return ENGINE_SYNC;
+    }
+    if (strcmp(name, "uring") == 0) {
+        return ENGINE_URING;
+    }
+    if (strcmp(name, "preadv") == 0) {
+        return ENGINE_PREADV;
+    }
+    if (strcmp(name, "nowait") == 0) {
+        return ENGINE_NOWAIT;
+    }
+    return -1;
+}
+
+static const char* counterFields[NUM_COUNTERS] = {"cycles", "instructions", "cache_misses", "page_faults",
+                                                  "context_switches", "cpu_migrations"};
+
+// Adds the events counted with -P; counters is NULL without it
+void addCounters(struct Result* result, const struct PerfCounters* counters) {
+    if (counters == NULL) {
+        return;
+    }
+    for (int i = 0; i < NUM_COUNTERS; ++i) {
+        if (counters->valid[i]) {
+            resultAddExtra(result, counterFields[i], counters->values[i]);
+        }
+    }
+    if (counters->valid[COUNTER_CYCLES] && counters->valid[COUNTER_INSTRUCTIONS] && counters->values[COUNTER_CYCLES] > 0) {
+        resultAddExtra(result, "ipc", (double)counters->values[COUNTER_INSTRUCTIONS] / counters->values[COUNTER_CYCLES]);
+    }
+    if (counters->userOnly) {
+        resultAddExtra(result, "counters_user_only", 1);
+    }
+    if (counters->scaled) {
+        resultAddExtra(result, "counters_scaled", 1);
+    }
+}
+
+// Adds the read's share of the memcpy bandwidth at its thread count, with -M
+void addMemoryShare(struct Result* result) {
+    if (!memoryCalibrated() || result->seconds <= 0) {
+        return;
+    }
+    double mibPerSec = (double)result->bytes / MEGABYTE / result->seconds;
+    resultAddExtra(result, "memcpy_share", memoryFraction(mibPerSec, result->threads));
+}
+
+// Reports every point of the memory bandwidth calibration as a membw result
+void reportMemoryCalibration(long budget) {
+    struct BandwidthPoint points[MEMBW_MAX_POINTS];
+    int count = memoryCalibrate(budget, points);
+
+    for (int i = 0; i < count; ++i) {
+        for (int op = 0; op < 2; ++op) {
+            struct Result result;
+            resultInit(&result, "membw", op == 0 ? "memcpy" : "read", "memory");
+            result.block_size = points[i].size;
+            result.threads = points[i].threads;
+            result.bytes = points[i].bytes;
+            result.ops = points[i].bytes / points[i].size;
+            result.seconds = op == 0 ? points[i].copySeconds : points[i].readSeconds;
+            reportResult(&result);
+        }
+    }
+}
+
+// Notes and returns 0 when the block size leaves no whole block of the file
+int blockFitsFile(int block_size, long long block_count) {
+    if (block_count > 0) {
+        return 1;
+    }
+    char note[128];
+    snprintf(note, sizeof(note), "Block Size %d is larger than the file, skipping", block_size);
+    reportNote(note);
+    return 0;
+}
+
+int runRead(const struct Options* options) {
+    long long size = fileSize(options->filename);
+
+    int memAlign = 0, offsetAlign = 0;
+    int directSupported = 1;
+    for (int m = 0; m < options->numModes; ++m) {
+        if (options->modes[m] == READ_DIRECT) {
+            directSupported = directIOAlignment(options->filename, &memAlign, &offsetAlign);
+        }
+    }
+
+    for (int m = 0; m < options->numModes; ++m) {
+        int mode = options->modes[m];
+        if (mode == READ_DIRECT && !directSupported) {
+            reportNote("Direct I/O is not supported on this filesystem, skipping direct mode");
+            continue;
+        }
+
+        for (int i = 0; i < options->numBlockSizes; ++i) {
+            int block_size = options->blockSizes[i];
+            if (mode == READ_DIRECT && block_size % offsetAlign != 0) {
+                char note[128];
+                block_size = roundToAlignment(block_size, offsetAlign);
+                snprintf(note, sizeof(note), "Block Size %d is illegal under O_DIRECT, using %d",
+                         options->blockSizes[i], block_size);
+                reportNote(note);
+            }
+            long long block_count = size / block_size;
+            if (!blockFitsFile(block_size, block_count)) {
+                continue;
+            }
+
+            for (int e = 0; e < options->numEngines; ++e) {
+                if (options->engines[e] == ENGINE_SYNC) {
+                    for (int r = 0; r < options->numReadahead; ++r) {
+                        struct LatencyHistogram hist;
+                        struct PerfCounters counters;
+                        struct PerfCounters* events = options->countEvents ? &counters : NULL;
+                        double totalTime = measureReadTime(options->filename, block_size, block_count, mode,
+                                                           &options->readahead[r], &hist, events);
+                        if (totalTime < 0) {
+                            continue;
+                        }
+
+                        char engine[64] = "sync";
+                        if (options->readahead[r].kind != READAHEAD_KERNEL) {
+                            snprintf(engine, sizeof(engine), "sync+");
+                            readaheadPolicyName(&options->readahead[r], engine + 5, sizeof(engine) - 5);
+                        }
+
+                        struct Result result;
+                        resultInit(&result, "read", engine, readModeName(mode));
+                        result.block_size = block_size;
+                        result.bytes = (long long)block_size * block_count;
+                        result.ops = block_count;
+                        result.seconds = totalTime;
+                        result.latency = &hist;
+                        if (block_size != options->blockSizes[i]) {
+                            resultAddExtra(&result, "requested_block_size", options->blockSizes[i]);
+                        }
+                        addCounters(&result, events);
+                        addMemoryShare(&result);
+                        reportResult(&result);
+                    }
+                    continue;
+                }
+
+                if (options->engines[e] == ENGINE_PREADV || options->engines[e] == ENGINE_NOWAIT) {
+                    int nowait = options->engines[e] == ENGINE_NOWAIT;
+                    for (int v = 0; v < options->numVectorSizes; ++v) {
+                        struct LatencyHistogram hist;
+                        struct VectoredStats stats;
+                        struct PerfCounters counters;
+                        struct PerfCounters* events = options->countEvents ? &counters : NULL;
+                        double totalTime = measureReadTimeVectored(options->filename, block_size, block_count,
+                                                                   options->vectorSizes[v], nowait, mode, &hist, &stats,
+                                                                   events);
+                        if (totalTime < 0) {
+                            continue;
+                        }
+
+                        struct Result result;
+                        resultInit(&result, "read", nowait ? "preadv2-nowait" : "preadv", readModeName(mode));
+                        result.block_size = block_size;
+                        result.bytes = (long long)block_size * block_count;
+                        result.ops = block_count;
+                        result.seconds = totalTime;
+                        result.latency = &hist;
+                        resultAddExtra(&result, "iovecs", options->vectorSizes[v]);
+                        resultAddExtra(&result, "syscalls", stats.calls);
+                        if (nowait) {
+                            resultAddExtra(&result, "cached_batches", stats.hits);
+                            resultAddExtra(&result, "partial_batches", stats.partial);
+                            resultAddExtra(&result, "missed_batches", stats.misses);
+                        }
+                        if (block_size != options->blockSizes[i]) {
+                            resultAddExtra(&result, "requested_block_size", options->blockSizes[i]);
+                        }
+                        addCounters(&result, events);
+                        addMemoryShare(&result);
+                        reportResult(&result);
+                    }
+                    continue;
+                }
+
+                for (int q = 0; q < options->numQueueDepths; ++q) {
+                    struct PerfCounters counters;
+                    struct PerfCounters* events = options->countEvents ? &counters : NULL;
+                    double totalTime = measureReadTimeUring(options->filename, block_size, block_count,
+                                                            options->queueDepths[q], mode, events);
+                    if (totalTime < 0) {
+                        continue;
+                    }
+
+                    struct Result result;
+                    resultInit(&result, "read", "uring", readModeName(mode));
+                    result.block_size = block_size;
+                    result.bytes = (long long)block_size * block_count;
+                    result.ops = block_count;
+                    result.seconds = totalTime;
+                    resultAddExtra(&result, "queue_depth", options->queueDepths[q]);
+                    if (block_size != options->blockSizes[i]) {
+                        resultAddExtra(&result, "requested_block_size", options->blockSizes[i]);
+                    }
+                    addCounters(&result, events);
+                    addMemoryShare(&result);
+                    reportResult(&result);
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int runParallel(const struct Options* options) {
+    long long size = fileSize(options->filename);
+    const char* strategy = options->strategy == CHUNK_STATIC ? "pread-static" : "pread-dynamic";
+
+    int memAlign = 0, offsetAlign = 1;
+    for (int m = 0; m < options->numModes; ++m) {
+        if (options->modes[m] == READ_DIRECT && !directIOAlignment(options->filename, &memAlign, &offsetAlign)) {
+            reportNote("Direct I/O is not supported on this filesystem");
+            return EXIT_FAILURE;
+        }
+    }
+
+    static int cpus[CPU_SETSIZE];
+    for (int m = 0; m < options->numModes; ++m) {
+        int mode = options->modes[m];
+
+        for (int a = 0; a < options->numAffinity; ++a) {
+            int policy = options->affinity[a];
+            int numCpus = policy == AFFINITY_NONE ? 0 : affinityOrder(policy, cpus);
+
+            char engine[64];
+            if (policy == AFFINITY_NONE) {
+                snprintf(engine, sizeof(engine), "%s", strategy);
+            } else {
+                snprintf(engine, sizeof(engine), "%s-%s", strategy, affinityName(policy));
+            }
+
+            // Speedup and efficiency are relative to the first thread count
+            // reported at the same block size under this placement
+            double baseline[MAX_LIST_VALUES] = {0};
+            int baselineThreads[MAX_LIST_VALUES] = {0};
+
+            for (int t = 0; t < options->numThreads; ++t) {
+                int threads = options->threads[t];
+
+                for (int i = 0; i < options->numBlockSizes; ++i) {
+                    int block_size = options->blockSizes[i];
+                    if (mode == READ_DIRECT) {
+                        block_size = roundToAlignment(block_size, offsetAlign);
+                    }
+                    long long block_count = size / block_size;
+                    if (!blockFitsFile(block_size, block_count)) {
+                        continue;
+                    }
+
+                    struct ThreadSkew skew;
+                    struct PerfCounters counters;
+                    struct PerfCounters* events = options->countEvents ? &counters : NULL;
+                    double totalTime = measureReadTimeParallel(options->filename, block_size, block_count, threads,
+                                                               options->strategy, options->chunkBlocks, mode, &skew,
+                                                               events, numCpus ? cpus : NULL, numCpus);
+                    if (totalTime < 0) {
+                        continue;
+                    }
+
+                    double throughput = (double)block_size * block_count / totalTime;
+                    if (baseline[i] == 0.0) {
+                        baseline[i] = throughput;
+                        baselineThreads[i] = threads;
+                    }
+                    double speedup = throughput / baseline[i];
+
+                    struct Result result;
+                    resultInit(&result, "parallel", engine, readModeName(mode));
+                    result.block_size = block_size;
+                    result.threads = threads;
+                    result.bytes = (long long)block_size * block_count;
+                    result.ops = block_count;
+                    result.seconds = totalTime;
+                    resultAddExtra(&result, "fastest_thread_s", skew.fastest);
+                    resultAddExtra(&result, "slowest_thread_s", skew.slowest);
+                    resultAddExtra(&result, "speedup", speedup);
+                    resultAddExtra(&result, "efficiency", speedup * baselineThreads[i] / threads);
+                    if (options->strategy == CHUNK_DYNAMIC) {
+                        resultAddExtra(&result, "chunk_blocks", options->chunkBlocks);
+                    }
+                    addCounters(&result, events);
+                    addMemoryShare(&result);
+                    reportResult(&result);
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int runRandom(const struct Options* options) {
+    long long size = fileSize(options->filename);
+
+    int memAlign = 0, offsetAlign = 1;
+    for (int m = 0; m < options->numModes; ++m) {
+        if (options->modes[m] == READ_DIRECT && !directIOAlignment(options->filename, &memAlign, &offsetAlign)) {
+            reportNote("Direct I/O is not supported on this filesystem");
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (int m = 0; m < options->numModes; ++m) {
+        int mode = options->modes[m];
+
+        for (int p = 0; p < options->numPatterns; ++p) {
+            char patternName[64];
+            accessPatternName(&options->patterns[p], patternName, sizeof(patternName));
+
+            for (int t = 0; t < options->numThreads; ++t) {
+                for (int i = 0; i < options->numBlockSizes; ++i) {
+                    int block_size = options->blockSizes[i];
+                    if (mode == READ_DIRECT) {
+                        block_size = roundToAlignment(block_size, offsetAlign);
+                    }
+                    long long block_count = size / block_size;
+                    if (!blockFitsFile(block_size, block_count)) {
+                        continue;
+                    }
+
+                    struct LatencyHistogram hist;
+                    struct PerfCounters counters;
+                    struct PerfCounters* events = options->countEvents ? &counters : NULL;
+                    double totalTime = measureRandomReadTime(options->filename, block_size, block_count,
+                                                             options->numReads, options->threads[t],
+                                                             &options->patterns[p], mode, &hist, events);
+                    if (totalTime < 0) {
+                        continue;
+                    }
+
+                    struct Result result;
+                    resultInit(&result, "random", patternName, readModeName(mode));
+                    result.block_size = block_size;
+                    result.threads = options->threads[t];
+                    result.bytes = (long long)block_size * options->numReads;
+                    result.ops = options->numReads;
+                    result.seconds = totalTime;
+                    result.latency = &hist;
+                    if (block_size != options->blockSizes[i]) {
+                        resultAddExtra(&result, "requested_block_size", options->blockSizes[i]);
+                    }
+                    addCounters(&result, events);
+                    addMemoryShare(&result);
+                    reportResult(&result);
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Every run starts from the file evicted and the requested share read back
+// in. The engine is "sync" for the sequential reader and the access pattern
+// for the random one, the mode is the warm layout.
+int runResidency(const struct Options* options) {
+    long long size = fileSize(options->filename);
+
+    for (int l = 0; l < options->numLayouts; ++l) {
+        char layoutName[64];
+        warmLayoutName(&options->layouts[l], layoutName, sizeof(layoutName));
+
+        for (int r = 0; r < options->numResidency; ++r) {
+            double fraction = options->residency[r] / 100.0;
+
+            for (int i = 0; i < options->numBlockSizes; ++i) {
+                int block_size = options->blockSizes[i];
+                long long block_count = size / block_size;
+                if (!blockFitsFile(block_size, block_count)) {
+                    continue;
+                }
+
+                double resident = warmFileFraction(options->filename, fraction, &options->layouts[l]);
+                if (resident < 0) {
+                    continue;
+                }
+
+                struct LatencyHistogram hist;
+                double totalTime = measureReadTime(options->filename, block_size, block_count, READ_CACHED, NULL,
+                                                   &hist, NULL);
+                if (totalTime < 0) {
+                    continue;
+                }
+
+                struct Result result;
+                resultInit(&result, "residency", "sync", layoutName);
+                result.block_size = block_size;
+                result.bytes = (long long)block_size * block_count;
+                result.ops = block_count;
+                result.seconds = totalTime;
+                result.latency = &hist;
+                resultAddExtra(&result, "target_residency", options->residency[r]);
+                resultAddExtra(&result, "residency", resident * 100);
+                reportResult(&result);
+
+                for (int p = 0; p < options->numPatterns; ++p) {
+                    char patternName[64];
+                    accessPatternName(&options->patterns[p], patternName, sizeof(patternName));
+
+                    for (int t = 0; t < options->numThreads; ++t) {
+                        resident = warmFileFraction(options->filename, fraction, &options->layouts[l]);
+                        if (resident < 0) {
+                            continue;
+                        }
+
+                        totalTime = measureRandomReadTime(options->filename, block_size, block_count,
+                                                          options->numReads, options->threads[t],
+                                                          &options->patterns[p], READ_CACHED, &hist, NULL);
+                        if (totalTime < 0) {
+                            continue;
+                        }
+
+                        resultInit(&result, "residency", patternName, layoutName);
+                        result.block_size = block_size;
+                        result.threads = options->threads[t];
+                        result.bytes = (long long)block_size * options->numReads;
+                        result.ops = options->numReads;
+                        result.seconds = totalTime;
+                        result.latency = &hist;
+                        resultAddExtra(&result, "target_residency", options->residency[r]);
+                        resultAddExtra(&result, "residency", resident * 100);
+                        reportResult(&result);
+                    }
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int runSmallFiles(const struct Options* options) {
+    struct FileTree tree;
+    buildFileTree(options->filename, options->numFiles, options->treeDepth, options->minFileSize,
+                  options->maxFileSize, &tree);
+
+    for (int m = 0; m < options->numModes; ++m) {
+        int mode = options->modes[m];
+        if (mode == READ_DIRECT) {
+            reportNote("Direct mode does not apply to small files, skipping");
+            continue;
+        }
+
+        for (int e = 0; e < options->numEngines; ++e) {
+            int uring = options->engines[e] == ENGINE_URING;
+            if (!uring && options->engines[e] != ENGINE_SYNC) {
+                continue;
+            }
+
+            int numRuns = uring ? options->numQueueDepths : options->numThreads;
+            for (int r = 0; r < numRuns; ++r) {
+                struct LatencyHistogram hist;
+                long long bytes;
+                double totalTime;
+                if (uring) {
+                    totalTime = measureSmallFilesUring(&tree, options->queueDepths[r], mode, &hist, &bytes);
+                } else {
+                    totalTime = measureSmallFiles(&tree, options->threads[r], mode, &hist, &bytes);
+                }
+                if (totalTime < 0) {
+                    continue;
+                }
+
+                // IOPS in the report are files per second
+                struct Result result;
+                resultInit(&result, "smallfiles", uring ? "uring" : "sync", readModeName(mode));
+                result.threads = uring ? 1 : options->threads[r];
+                result.bytes = bytes;
+                result.ops = tree.numFiles;
+                result.seconds = totalTime;
+                result.latency = &hist;
+                if (uring) {
+                    resultAddExtra(&result, "batch_files", options->queueDepths[r]);
+                }
+                reportResult(&result);
+            }
+        }
+    }
+
+    freeFileTree(&tree);
+
+    return EXIT_SUCCESS;
+}
+
+int runXor(const struct Options* options) {
+    long long size = fileSize(options->filename);
+
+    for (int t = 0; t < options->numThreads; ++t) {
+        const char* kernelName;
+        double start = timingSeconds();
+        uint64_t checksum = xorChecksum(options->filename, options->threads[t], &kernelName);
+        double totalTime = timingSeconds() - start;
+
+        char note[128];
+        snprintf(note, sizeof(note), "XOR checksum: %016llx", (unsigned long long)checksum);
+        reportNote(note);
+
+        if (options->verify) {
+            uint64_t reference = xorChecksumReference(options->filename);
+            if (reference != checksum) {
+                fprintf(stderr, "XOR mismatch: scalar reference gives %016llx\n", (unsigned long long)reference);
+                return EXIT_FAILURE;
+            }
+        }
+
+        struct Result result;
+        resultInit(&result, "xor", kernelName, "mmap");
+        result.threads = options->threads[t];
+        result.bytes = size;
+        result.seconds = totalTime;
+        resultAddChecksum(&result, checksum);
+        reportResult(&result);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Block sizes are the ring buffer sizes, thread counts the XOR workers
+int runPipeline(const struct Options* options) {
+    for (int m = 0; m < options->numModes; ++m) {
+        int mode = options->modes[m];
+        if (mode == READ_DIRECT) {
+            reportNote("The pipeline reads through the page cache, skipping direct");
+            continue;
+        }
+
+        for (int q = 0; q < options->numQueueDepths; ++q) {
+            for (int t = 0; t < options->numThreads; ++t) {
+                for (int i = 0; i < options->numBlockSizes; ++i) {
+                    struct PipelineRun run;
+                    if (!measurePipeline(options->filename, options->blockSizes[i], options->queueDepths[q],
+                                         options->threads[t], mode, &run)) {
+                        continue;
+                    }
+
+                    struct Result result;
+                    resultInit(&result, "pipeline", "xor", readModeName(mode));
+                    result.block_size = run.bufferSize;
+                    result.threads = run.numWorkers;
+                    result.bytes = run.bytes;
+                    result.ops = (run.bytes + run.bufferSize - 1) / run.bufferSize;
+                    result.seconds = run.pipelineTime;
+                    resultAddExtra(&result, "ring_depth", run.depth);
+                    resultAddExtra(&result, "read_s", run.readTime);
+                    resultAddExtra(&result, "compute_s", run.computeTime);
+                    resultAddExtra(&result, "serial_s", run.serialTime);
+                    resultAddExtra(&result, "speedup", run.serialTime / run.pipelineTime);
+                    double overlap;
+                    if (pipelineOverlap(&run, &overlap)) {
+                        resultAddExtra(&result, "overlap_efficiency", overlap);
+                    }
+                    reportResult(&result);
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// GB/s is reported twice: for the whole read+checksum loop (bytes/seconds)
+// and for the engine alone, from the time spent inside checksumUpdate().
+int runChecksum(const struct Options* options) {
+    long long size = fileSize(options->filename);
+
+    for (int m = 0; m < options->numModes; ++m) {
+        int mode = options->modes[m];
+        if (mode == READ_DIRECT) {
+            reportNote("checksum reads through the page cache, skipping direct mode");
+            continue;
+        }
+
+        for (int k = 0; k < options->numChecksums; ++k) {
+            int engine = options->checksums[k];
+            char engineName[64];
+            snprintf(engineName, sizeof(engineName), "%s-%s", checksumEngineName(engine),
+                     checksumImplementation(engine));
+
+            for (int i = 0; i < options->numBlockSizes; ++i) {
+                int block_size = options->blockSizes[i];
+                long long block_count = (size + block_size - 1) / block_size;
+
+                double computeTime;
+                uint64_t value;
+                double totalTime = measureChecksum(options->filename, block_size, block_count, engine, mode,
+                                                   &computeTime, &value);
+                if (totalTime < 0) {
+                    continue;
+                }
+
+                if (options->verify && engine == CHECKSUM_CRC32C) {
+                    double unused;
+                    uint64_t reference;
+                    measureChecksum(options->filename, block_size, block_count, CHECKSUM_CRC32C_SW, READ_CACHED,
+                                    &unused, &reference);
+                    if (reference != value) {
+                        fprintf(stderr, "CRC32C mismatch: table-driven reference gives %08llx\n",
+                                (unsigned long long)reference);
+                        return EXIT_FAILURE;
+                    }
+                }
+
+                if (i == 0) {
+                    char note[128];
+                    snprintf(note, sizeof(note), "%s: %0*llx", checksumEngineName(engine),
+                             engine == CHECKSUM_XXH64 ? 16 : 8, (unsigned long long)value);
+                    reportNote(note);
+                }
+
+                        struct Result result;
+                resultInit(&result, "checksum", engineName, readModeName(mode));
+                result.block_size = block_size;
+                result.bytes = size;
+                result.ops = block_count;
+                result.seconds = totalTime;
+                resultAddExtra(&result, "gb_per_s", size / totalTime / 1e9);
+                resultAddExtra(&result, "engine_gb_per_s", computeTime > 0 ? size / computeTime / 1e9 : 0.0);
+                resultAddChecksum(&result, value);
+                reportResult(&result);
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int runWrite(const struct Options* options) {
+    int memAlign = 0, offsetAlign = 1;
+    int directSupported = 1;
+    for (int w = 0; w < options->numWriteModes; ++w) {
+        if (options->writeModes[w] == WRITE_DIRECT) {
+            directSupported = directIOAlignment(options->filename, &memAlign, &offsetAlign);
+        }
+    }
+
+    for (int w = 0; w < options->numWriteModes; ++w) {
+        int mode = options->writeModes[w];
+        if (mode == WRITE_DIRECT && !directSupported) {
+            reportNote("Direct I/O is not supported on this filesystem, skipping direct mode");
+            continue;
+        }
+
+        for (int i = 0; i < options->numBlockSizes; ++i) {
+            int block_size = options->blockSizes[i];
+            if (mode == WRITE_DIRECT) {
+                block_size = roundToAlignment(block_size, offsetAlign);
+            }
+            long long block_count = options->writeBytes / block_size;
+
+            for (int y = 0; y < options->numSyncPolicies; ++y) {
+                char policyName[32];
+                syncPolicyName(&options->syncPolicies[y], policyName, sizeof(policyName));
+
+                for (int a = 0; a < options->numPreallocate; ++a) {
+                    struct LatencyHistogram hist;
+                    struct PerfCounters counters;
+                    struct PerfCounters* events = options->countEvents ? &counters : NULL;
+                    double totalTime = measureWriteTime(options->filename, block_size, block_count, mode,
+                                                        &options->syncPolicies[y], options->preallocate[a], &hist,
+                                                        events);
+                    if (totalTime < 0) {
+                        continue;
+                    }
+
+                    struct Result result;
+                    resultInit(&result, "write", writeModeName(mode), policyName);
+                    result.block_size = block_size;
+                    result.bytes = (long long)block_size * block_count;
+                    result.ops = block_count;
+                    result.seconds = totalTime;
+                    result.latency = &hist;
+                    resultAddExtra(&result, "fallocate", options->preallocate[a]);
+                    if (block_size != options->blockSizes[i]) {
+                        resultAddExtra(&result, "requested_block_size", options->blockSizes[i]);
+                    }
+                    addCounters(&result, events);
+                    reportResult(&result);
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int runWal(const struct Options* options) {
+    char mode[32];
+    snprintf(mode, sizeof(mode), "window:%dus", options->windowUs);
+
+    for (int t = 0; t < options->numThreads; ++t) {
+        int producers = options->threads[t];
+        struct LatencyHistogram hist;
+        long long batches;
+        double totalTime = measureGroupCommit(options->filename, options->recordSize, options->recordsPerThread,
+                                              producers, options->windowUs, options->maxBatch, &hist, &batches);
+        if (totalTime < 0) {
+            continue;
+        }
+
+        long long records = options->recordsPerThread * producers;
+        struct Result result;
+        resultInit(&result, "wal", "fdatasync", mode);
+        result.block_size = options->recordSize;
+        result.threads = producers;
+        result.bytes = records * options->recordSize;
+        result.ops = records;
+        result.seconds = totalTime;
+        result.latency = &hist;
+        resultAddExtra(&result, "commits", batches);
+        resultAddExtra(&result, "records_per_commit", (double)records / batches);
+        if (options->maxBatch > 0) {
+            resultAddExtra(&result, "max_batch", options->maxBatch);
+        }
+        reportResult(&result);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    const struct Command* command = NULL;
+    for (int i = 0; i < numCommands; ++i) {
+        if (strcmp(argv[1], commands[i].name) == 0) {
+            command = &commands[i];
+        }
+    }
+    if (command == NULL) {
+        fprintf(stderr, "Unknown command: %s\n", argv[1]);
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    struct Options options;
+    memset(&options, 0, sizeof(options));
+    memcpy(options.blockSizes, defaultBlockSizes, sizeof(int) * numDefaultBlockSizes);
+    options.numBlockSizes = numDefaultBlockSizes;
+    options.modes[0] = READ_CACHED;
+    options.modes[1] = READ_COLD;
+    options.numModes = 2;
+    options.engines[0] = ENGINE_SYNC;
+    options.numEngines = 1;
+    int defaultDepths[] = {1, 4, 16, 64};
+    memcpy(options.queueDepths, defaultDepths, sizeof(defaultDepths));
+    options.numQueueDepths = 4;
+    options.readahead[0].kind = READAHEAD_KERNEL;
+    options.numReadahead = 1;
+    options.vectorSizes[0] = 16;
+    options.numVectorSizes = 1;
+    options.threads[0] = 4;
+    options.numThreads = 1;
+    options.strategy = CHUNK_STATIC;
+    options.chunkBlocks = 256;
+    options.affinity[0] = AFFINITY_NONE;
+    options.numAffinity = 1;
+    options.writeModes[0] = WRITE_BUFFERED;
+    options.numWriteModes = 1;
+    options.numSyncPolicies = parseList("none,fdatasync,fdatasync:64", MAX_LIST_VALUES, parseSyncPolicyToken, options.syncPolicies);
+    options.numPreallocate = 1;
+    options.writeBytes = 256LL * MEGABYTE;
+    options.numPatterns = parseList("sequential,uniform,zipf:0.99", MAX_LIST_VALUES, parsePatternToken, options.patterns);
+    options.numReads = 100000;
+    options.numResidency = parseList("0,10,25,50,75,90,100", MAX_LIST_VALUES, parsePercentToken, options.residency);
+    options.numChecksums = parseNameList("crc32c,crc32c-sw,xxh64", options.checksums, MAX_LIST_VALUES,
+                                         parseChecksumEngine);
+    options.numLayouts = parseList("prefix,random,striped", MAX_LIST_VALUES, parseLayoutToken, options.layouts);
+    options.numFiles = 10000;
+    options.minFileSize = 4 * KILOBYTE;
+    options.maxFileSize = 64 * KILOBYTE;
+    options.treeDepth = 2;
+    options.recordSize = 128;
+    options.recordsPerThread = 2000;
+
+    int format = FORMAT_TEXT;
+    const char* outputPath = NULL;
+    int pages = POOL_PAGES_NORMAL;
+    long memoryBudget = 0;
+
+    // Options follow the command name
+    int opt;
+    optind = 2;
+    while ((opt = getopt(argc, argv, "b:m:e:A:q:v:t:s:c:C:w:y:a:S:p:N:R:L:F:z:D:r:n:W:B:k:xPH:M:f:o:")) != -1) {
+        int ok = 1;
+        long long value = 0;
+        switch (opt) {
+            case 'b':
+                ok = (options.numBlockSizes = parseIntList(optarg, options.blockSizes, MAX_LIST_VALUES)) > 0;
+                break;
+            case 'm':
+                ok = (options.numModes = parseNameList(optarg, options.modes, MAX_LIST_VALUES, parseReadMode)) > 0;
+                break;
+            case 'e':
+                ok = (options.numEngines = parseNameList(optarg, options.engines, MAX_LIST_VALUES, parseEngine)) > 0;
+                break;
+            case 'q':
+                ok = (options.numQueueDepths = parseIntList(optarg, options.queueDepths, MAX_LIST_VALUES)) > 0;
+                break;
+            case 'A':
+                ok = (options.numReadahead = parseList(optarg, MAX_LIST_VALUES, parseReadaheadToken, options.readahead)) > 0;
+                break;
+            case 'v':
+                ok = (options.numVectorSizes = parseIntList(optarg, options.vectorSizes, MAX_LIST_VALUES)) > 0;
+                for (int i = 0; ok && i < options.numVectorSizes; ++i) {
+                    ok = options.vectorSizes[i] <= IOV_MAX;  // preadv() fails with EINVAL beyond it
+                }
+                break;
+            case 't':
+                ok = (options.numThreads = parseIntList(optarg, options.threads, MAX_LIST_VALUES)) > 0;
+                break;
+            case 's':
+                ok = strcmp(optarg, "static") == 0 || strcmp(optarg, "dynamic") == 0;
+                options.strategy = strcmp(optarg, "dynamic") == 0 ? CHUNK_DYNAMIC : CHUNK_STATIC;
+                break;
+            case 'c':
+                ok = parseInteger(optarg, 1, INT_MAX, &value);
+                options.chunkBlocks = value;
+                break;
+            case 'C':
+                ok = (options.numAffinity = parseNameList(optarg, options.affinity, MAX_LIST_VALUES, parseAffinity)) > 0;
+                break;
+            case 'w':
+                ok = (options.numWriteModes = parseNameList(optarg, options.writeModes, MAX_LIST_VALUES, parseWriteMode)) > 0;
+                break;
+            case 'y':
+                ok = (options.numSyncPolicies = parseList(optarg, MAX_LIST_VALUES, parseSyncPolicyToken, options.syncPolicies)) > 0;
+                break;
+            case 'a':
+                ok = (options.numPreallocate = parseNameList(optarg, options.preallocate, 2, parseSwitch)) > 0;
+                break;
+            case 'S':
+                ok = parseInteger(optarg, 1, LLONG_MAX / MEGABYTE, &value);
+                options.writeBytes = value * MEGABYTE;
+                break;
+            case 'p':
+                ok = (options.numPatterns = parseList(optarg, MAX_LIST_VALUES, parsePatternToken, options.patterns)) > 0;
+                break;
+            case 'N':
+                ok = parseInteger(optarg, 1, LLONG_MAX, &value);
+                options.numReads = value;
+                break;
+            case 'R':
+                ok = (options.numResidency = parseList(optarg, MAX_LIST_VALUES, parsePercentToken, options.residency)) > 0;
+                break;
+            case 'L':
+                ok = (options.numLayouts = parseList(optarg, MAX_LIST_VALUES, parseLayoutToken, options.layouts)) > 0;
+                break;
+            case 'F':
+                ok = parseInteger(optarg, 1, INT_MAX, &value);
+                options.numFiles = value;
+                break;
+            case 'z':
+                ok = parseSizeRange(optarg, &options.minFileSize, &options.maxFileSize);
+                break;
+            case 'D':
+                ok = parseInteger(optarg, 0, 4, &value);
+                options.treeDepth = value;
+                break;
+            case 'r':
+                ok = parseInteger(optarg, 1, INT_MAX, &value);
+                options.recordSize = value;
+                break;
+            case 'n':
+                ok = parseInteger(optarg, 1, LLONG_MAX, &value);
+                options.recordsPerThread = value;
+                break;
+            case 'W':
+                ok = parseInteger(optarg, 0, INT_MAX, &value);
+                options.windowUs = value;
+                break;
+            case 'B':
+                ok = parseInteger(optarg, 0, INT_MAX, &value);
+                options.maxBatch = value;
+                break;
+            case 'k':
+                ok = (options.numChecksums = parseNameList(optarg, options.checksums, MAX_LIST_VALUES,
+                                                           parseChecksumEngine)) > 0;
+                break;
+            case 'x':
+                options.verify = 1;
+                break;
+            case 'P':
+                options.countEvents = 1;
+                break;
+            case 'H':
+                ok = (pages = poolParsePages(optarg)) >= 0;
+                break;
+            case 'M':
+                ok = parseInteger(optarg, 1, LONG_MAX / MEGABYTE, &value);
+                memoryBudget = value * MEGABYTE;
+                break;
+            case 'f':
+                ok = (format = parseFormat(optarg)) >= 0;
+                break;
+            case 'o':
+                outputPath = optarg;
+                break;
+            default:
+                ok = 0;
+                break;
+        }
+        if (!ok) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != 1) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+    options.filename = argv[optind];
+
+    // Drop io_uring up front when the kernel does not allow it
+    for (int e = 0; e < options.numEngines; ++e) {
+        if (options.engines[e] == ENGINE_URING && !uringAvailable()) {
+            options.engines[e] = options.engines[--options.numEngines];
+            e--;
+        }
+    }
+    if (options.numEngines == 0) {
+        options.engines[options.numEngines++] = ENGINE_SYNC;
+    }
+
+    // Commands that build their own data create it first so metadata can be read
+    if (command->creates == CREATES_FILE) {
+        int fd = open(options.filename, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+        if (fd == -1) {
+            perror("Error creating file");
+            return EXIT_FAILURE;
+        }
+        close(fd);
+    } else if (command->creates == CREATES_DIRECTORY && mkdir(options.filename, S_IRWXU) == -1 && errno != EEXIST) {
+        perror("Error creating directory");
+        return EXIT_FAILURE;
+    }
+
+    FILE* out = stdout;
+    if (outputPath != NULL && (out = fopen(outputPath, "w")) == NULL) {
+        perror("Error opening output file");
+        return EXIT_FAILURE;
+    }
+
+    timingInit();
+    poolSetPages(pages);
+
+    reportBegin(out, format, argc, argv, options.filename);
+    if (pages != POOL_PAGES_NORMAL) {
+        char note[64];
+        snprintf(note, sizeof(note), "I/O buffers on %s pages", poolPagesName(pages));
+        reportNote(note);
+    }
+    if (memoryBudget > 0) {
+        reportMemoryCalibration(memoryBudget);
+    }
+    int status = command->run(&options);
+    reportEnd();
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return status;
+}
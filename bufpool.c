@@ -0,0 +1,214 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "bufpool.h"
+
+#define BASE_PAGE 4096
+
+struct PoolBuffer {
+    char* data;
+    size_t size;    // Usable bytes, a whole number of pages
+    size_t mapped;  // Bytes to munmap()
+    int pages;      // Kind the buffer really got
+    int requested;  // Kind it was acquired for
+    int inUse;
+};
+
+static const char* pageNames[] = {"4k", "thp", "hugetlb"};
+
+// Grown as needed, there is no limit on the number of buffers in use
+static struct PoolBuffer* buffers;
+static int numBuffers;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static int pageKind = POOL_PAGES_NORMAL;
+static int hugetlbWarned = 0;
+
+int poolParsePages(const char* name) {
+    for (int kind = POOL_PAGES_NORMAL; kind <= POOL_PAGES_HUGETLB; ++kind) {
+        if (strcmp(name, pageNames[kind]) == 0) {
+            return kind;
+        }
+    }
+    return -1;
+}
+
+const char* poolPagesName(int kind) {
+    return pageNames[kind];
+}
+
+void poolSetPages(int kind) {
+    pageKind = kind;
+}
+
+static void unmapBuffer(struct PoolBuffer* buffer) {
+    munmap(buffer->data, buffer->mapped);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+// Maps size bytes of the requested kind into buffer
+static void mapBuffer(struct PoolBuffer* buffer, size_t size, int kind) {
+    size_t page = kind == POOL_PAGES_NORMAL ? BASE_PAGE : POOL_HUGE_PAGE;
+    size = (size + page - 1) / page * page;
+
+    buffer->requested = kind;
+    buffer->size = size;
+
+    if (kind == POOL_PAGES_HUGETLB) {
+        void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data != MAP_FAILED) {
+            buffer->data = data;
+            buffer->mapped = size;
+            buffer->pages = POOL_PAGES_HUGETLB;
+            return;
+        }
+        if (!hugetlbWarned) {
+            fprintf(stderr, "MAP_HUGETLB failed (%s), using transparent huge pages; reserve pages with "
+                            "/proc/sys/vm/nr_hugepages\n", strerror(errno));
+            hugetlbWarned = 1;
+        }
+        kind = POOL_PAGES_THP;
+    }
+
+    // Over-map by one huge page so the buffer can start on a huge page boundary
+    size_t mapped = kind == POOL_PAGES_THP ? size + POOL_HUGE_PAGE : size;
+    char* data = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        perror("Error mapping buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    if (kind == POOL_PAGES_THP) {
+        char* aligned = (char*)(((uintptr_t)data + POOL_HUGE_PAGE - 1) & ~(uintptr_t)(POOL_HUGE_PAGE - 1));
+        if (aligned > data) {
+            munmap(data, aligned - data);
+        }
+        munmap(aligned + size, data + mapped - (aligned + size));
+        data = aligned;
+        mapped = size;
+    }
+
+    // Explicit either way, so base-page buffers stay on base pages under THP "always"
+    madvise(data, size, kind == POOL_PAGES_THP ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+
+    buffer->data = data;
+    buffer->mapped = mapped;
+    buffer->pages = kind;
+}
+
+// Returns a buffer of at least size bytes of the current page kind, faulted in
+char* poolAcquire(size_t size) {
+    if (size > POOL_MAX_SIZE) {
+        fprintf(stderr, "Buffer of %zu bytes is larger than the pool limit of %lu\n", size, POOL_MAX_SIZE);
+        exit(EXIT_FAILURE);
+    }
+    if (size == 0) {
+        size = 1;
+    }
+
+    pthread_mutex_lock(&poolLock);
+
+    // Smallest free buffer that fits
+    struct PoolBuffer* best = NULL;
+    for (int i = 0; i < numBuffers; ++i) {
+        struct PoolBuffer* b = &buffers[i];
+        if (b->data != NULL && !b->inUse && b->requested == pageKind && b->size >= size &&
+            (best == NULL || b->size < best->size)) {
+            best = b;
+        }
+    }
+
+    if (best == NULL) {
+        // Free buffers that could not serve this request are dropped, which
+        // keeps the pool to the buffers in use plus the largest spare
+        struct PoolBuffer* slot = NULL;
+        for (int i = 0; i < numBuffers; ++i) {
+            struct PoolBuffer* b = &buffers[i];
+            if (b->data != NULL && !b->inUse) {
+                unmapBuffer(b);
+            }
+            if (b->data == NULL && slot == NULL) {
+                slot = b;
+            }
+        }
+        if (slot == NULL) {
+            int grown = numBuffers ? 2 * numBuffers : 16;
+            struct PoolBuffer* larger = realloc(buffers, sizeof(struct PoolBuffer) * grown);
+            if (larger == NULL) {
+                perror("Error growing buffer pool");
+                exit(EXIT_FAILURE);
+            }
+            memset(larger + numBuffers, 0, sizeof(struct PoolBuffer) * (grown - numBuffers));
+            buffers = larger;
+            slot = &buffers[numBuffers];
+            numBuffers = grown;
+        }
+
+        mapBuffer(slot, size, pageKind);
+        memset(slot->data, 0, slot->size);
+        best = slot;
+    }
+
+    best->inUse = 1;
+    pthread_mutex_unlock(&poolLock);
+
+    return best->data;
+}
+
+void poolRelease(char* buffer) {
+    pthread_mutex_lock(&poolLock);
+    for (int i = 0; i < numBuffers; ++i) {
+        if (buffers[i].data == buffer) {
+            buffers[i].inUse = 0;
+        }
+    }
+    pthread_mutex_unlock(&poolLock);
+}
+
+int poolBufferPages(const char* buffer) {
+    int pages = POOL_PAGES_NORMAL;
+    pthread_mutex_lock(&poolLock);
+    for (int i = 0; i < numBuffers; ++i) {
+        if (buffers[i].data == buffer) {
+            pages = buffers[i].pages;
+        }
+    }
+    pthread_mutex_unlock(&poolLock);
+    return pages;
+}
+
+// Huge page bytes of the mapping holding buffer, from /proc/self/smaps.
+// THP can silently give base pages, so this is what the run really used.
+size_t poolHugeBytes(const char* buffer) {
+    FILE* smaps = fopen("/proc/self/smaps", "r");
+    if (smaps == NULL) {
+        return 0;
+    }
+
+    char line[256];
+    int inMapping = 0;
+    size_t hugeKB = 0;
+    while (fgets(line, sizeof(line), smaps) != NULL) {
+        unsigned long start, end;
+        size_t kb;
+        // Mapping headers start with "start-end ", field lines with "Name:"
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            inMapping = (uintptr_t)buffer >= start && (uintptr_t)buffer < end;
+            continue;
+        }
+        if (!inMapping) {
+            continue;
+        }
+        if (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1 || sscanf(line, "Private_Hugetlb: %zu kB", &kb) == 1 ||
+            sscanf(line, "Shared_Hugetlb: %zu kB", &kb) == 1) {
+            hugeKB += kb;
+        }
+    }
+
+    fclose(smaps);
+    return hugeKB * 1024;
+}
@@ -0,0 +1,32 @@
+#ifndef BUFPOOL_H
+#define BUFPOOL_H
+
+#include <stddef.h>
+
+// Reusable I/O buffers for the benchmarks. Buffers are mmap()ed, page aligned
+// (huge-page aligned for the huge page kinds), faulted in before they are
+// handed out and kept after poolRelease() for the next poolAcquire() of the
+// same page kind, so the timed loops never pay for allocation or page faults.
+// Functions print the reason and exit when memory cannot be mapped.
+
+#define POOL_PAGES_NORMAL 0   // Base pages, transparent huge pages disabled for the buffer
+#define POOL_PAGES_THP 1      // madvise(MADV_HUGEPAGE)
+#define POOL_PAGES_HUGETLB 2  // MAP_HUGETLB from the reserved pool, falls back to THP
+
+#define POOL_HUGE_PAGE (2UL * 1024 * 1024)
+#define POOL_MAX_SIZE (1UL << 30)  // Largest buffer the pool hands out
+
+int poolParsePages(const char* name);
+const char* poolPagesName(int kind);
+
+// Page kind used by poolAcquire() from now on
+void poolSetPages(int kind);
+
+char* poolAcquire(size_t size);
+void poolRelease(char* buffer);
+
+// Page kind the buffer really got and how many of its bytes sit on huge pages
+int poolBufferPages(const char* buffer);
+size_t poolHugeBytes(const char* buffer);
+
+#endif
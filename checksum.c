@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "checksum.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define HAVE_SSE42_CRC 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78u  // Castagnoli polynomial, bit reversed
+
+#define XXH_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3 0x165667B19E3779F9ULL
+#define XXH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5 0x27D4EB2F165667C5ULL
+
+static const char* engineNames[NUM_CHECKSUM_ENGINES] = {"crc32c", "crc32c-sw", "xxh64"};
+
+static uint32_t crcTable[8][256];
+static pthread_once_t crcTableOnce = PTHREAD_ONCE_INIT;
+static int useHardwareCRC = -1;
+
+int parseChecksumEngine(const char* name) {
+    for (int engine = 0; engine < NUM_CHECKSUM_ENGINES; ++engine) {
+        if (strcmp(name, engineNames[engine]) == 0) {
+            return engine;
+        }
+    }
+    return -1;
+}
+
+const char* checksumEngineName(int engine) {
+    return engineNames[engine];
+}
+
+static int hardwareCRC(void) {
+    if (useHardwareCRC < 0) {
+#ifdef HAVE_SSE42_CRC
+        __builtin_cpu_init();
+        useHardwareCRC = __builtin_cpu_supports("sse4.2");
+#else
+        useHardwareCRC = 0;
+#endif
+    }
+    return useHardwareCRC;
+}
+
+const char* checksumImplementation(int engine) {
+    if (engine == CHECKSUM_CRC32C && hardwareCRC()) {
+        return "sse4.2";
+    }
+    return engine == CHECKSUM_XXH64 ? "scalar" : "slice8";
+}
+
+// crcTable[k][b] is the CRC of byte b followed by k zero bytes
+static void buildCRCTable(void) {
+    for (int b = 0; b < 256; ++b) {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crcTable[0][b] = crc;
+    }
+    for (int b = 0; b < 256; ++b) {
+        for (int k = 1; k < 8; ++k) {
+            crcTable[k][b] = (crcTable[k - 1][b] >> 8) ^ crcTable[0][crcTable[k - 1][b] & 0xff];
+        }
+    }
+}
+
+static uint32_t crc32cSlice8(uint32_t crc, const unsigned char* data, size_t size) {
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        uint32_t low = (uint32_t)word ^ crc;
+        uint32_t high = (uint32_t)(word >> 32);
+        crc = crcTable[7][low & 0xff] ^ crcTable[6][(low >> 8) & 0xff] ^
+              crcTable[5][(low >> 16) & 0xff] ^ crcTable[4][low >> 24] ^
+              crcTable[3][high & 0xff] ^ crcTable[2][(high >> 8) & 0xff] ^
+              crcTable[1][(high >> 16) & 0xff] ^ crcTable[0][high >> 24];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ *data++) & 0xff];
+    }
+    return crc;
+}
+
+#ifdef HAVE_SSE42_CRC
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(uint32_t crc, const unsigned char* data, size_t size) {
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        size -= 8;
+    }
+    crc = (uint32_t)crc64;
+#endif
+    while (size-- > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+static uint64_t rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t read64(const unsigned char* p) {
+    uint64_t value;
+    memcpy(&value, p, 8);
+    return value;
+}
+
+static uint64_t xxhRound(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_PRIME1;
+}
+
+static uint64_t xxhMerge(uint64_t hash, uint64_t acc) {
+    hash ^= xxhRound(0, acc);
+    return hash * XXH_PRIME1 + XXH_PRIME4;
+}
+
+// Consumes whole 32-byte stripes and returns the bytes used
+static size_t xxhStripes(uint64_t* acc, const unsigned char* data, size_t size) {
+    size_t used = 0;
+    uint64_t a0 = acc[0], a1 = acc[1], a2 = acc[2], a3 = acc[3];
+    while (size - used >= 32) {
+        a0 = xxhRound(a0, read64(data + used));
+        a1 = xxhRound(a1, read64(data + used + 8));
+        a2 = xxhRound(a2, read64(data + used + 16));
+        a3 = xxhRound(a3, read64(data + used + 24));
+        used += 32;
+    }
+    acc[0] = a0;
+    acc[1] = a1;
+    acc[2] = a2;
+    acc[3] = a3;
+    return used;
+}
+
+void checksumInit(struct ChecksumState* state, int engine) {
+    memset(state, 0, sizeof(*state));
+    state->engine = engine;
+    state->crc = 0xFFFFFFFFu;
+    state->acc[0] = XXH_PRIME1 + XXH_PRIME2;
+    state->acc[1] = XXH_PRIME2;
+    state->acc[2] = 0;
+    state->acc[3] = -XXH_PRIME1;
+    pthread_once(&crcTableOnce, buildCRCTable);
+    hardwareCRC();
+}
+
+void checksumUpdate(struct ChecksumState* state, const void* data, size_t size) {
+    const unsigned char* p = data;
+    state->total += size;
+
+    if (state->engine != CHECKSUM_XXH64) {
+#ifdef HAVE_SSE42_CRC
+        if (state->engine == CHECKSUM_CRC32C && useHardwareCRC) {
+            state->crc = crc32cHardware(state->crc, p, size);
+            return;
+        }
+#endif
+        state->crc = crc32cSlice8(state->crc, p, size);
+        return;
+    }
+
+    // Top up a partial stripe left by the previous update first
+    if (state->buffered > 0) {
+        size_t take = 32 - state->buffered < size ? 32 - state->buffered : size;
+        memcpy(state->stripe + state->buffered, p, take);
+        state->buffered += take;
+        p += take;
+        size -= take;
+        if (state->buffered < 32) {
+            return;
+        }
+        xxhStripes(state->acc, state->stripe, 32);
+        state->buffered = 0;
+    }
+
+    size_t used = xxhStripes(state->acc, p, size);
+    memcpy(state->stripe, p + used, size - used);
+    state->buffered = size - used;
+}
+
+uint64_t checksumFinal(const struct ChecksumState* state) {
+    if (state->engine != CHECKSUM_XXH64) {
+        return state->crc ^ 0xFFFFFFFFu;
+    }
+
+    uint64_t hash;
+    if (state->total >= 32) {
+        hash = rotl64(state->acc[0], 1) + rotl64(state->acc[1], 7) + rotl64(state->acc[2], 12) +
+               rotl64(state->acc[3], 18);
+        for (int i = 0; i < 4; ++i) {
+            hash = xxhMerge(hash, state->acc[i]);
+        }
+    } else {
+        hash = XXH_PRIME5;
+    }
+    hash += state->total;
+
+    const unsigned char* p = state->stripe;
+    size_t size = state->buffered;
+    while (size >= 8) {
+        hash ^= xxhRound(0, read64(p));
+        hash = rotl64(hash, 27) * XXH_PRIME1 + XXH_PRIME4;
+        p += 8;
+        size -= 8;
+    }
+    if (size >= 4) {
+        uint32_t word;
+        memcpy(&word, p, 4);
+        hash ^= (uint64_t)word * XXH_PRIME1;
+        hash = rotl64(hash, 23) * XXH_PRIME2 + XXH_PRIME3;
+        p += 4;
+        size -= 4;
+    }
+    while (size-- > 0) {
+        hash ^= *p++ * XXH_PRIME5;
+        hash = rotl64(hash, 11) * XXH_PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
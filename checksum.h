@@ -0,0 +1,37 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming checksums for verifying data on the read path. A state is set up
+// with checksumInit(), fed any number of checksumUpdate() calls of any size
+// and read with checksumFinal(); the result does not depend on how the data
+// was split between updates.
+
+#define CHECKSUM_CRC32C 0     // CRC32C, crc32 instruction when the CPU has SSE4.2
+#define CHECKSUM_CRC32C_SW 1  // CRC32C, slicing-by-8 tables
+#define CHECKSUM_XXH64 2      // xxHash64 with seed 0, not cryptographic
+
+#define NUM_CHECKSUM_ENGINES 3
+
+struct ChecksumState {
+    int engine;
+    uint32_t crc;
+    uint64_t acc[4];          // xxHash64 lane accumulators
+    unsigned char stripe[32];  // Bytes waiting for a full xxHash64 stripe
+    size_t buffered;
+    uint64_t total;
+};
+
+int parseChecksumEngine(const char* name);
+const char* checksumEngineName(int engine);
+
+// Code that actually runs for the engine, e.g. "sse4.2" or "slice8"
+const char* checksumImplementation(int engine);
+
+void checksumInit(struct ChecksumState* state, int engine);
+void checksumUpdate(struct ChecksumState* state, const void* data, size_t size);
+uint64_t checksumFinal(const struct ChecksumState* state);
+
+#endif
@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "counters.h"
+
+#define SINGLE_FORMAT (PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING)
+#define GROUP_FORMAT (PERF_FORMAT_GROUP | SINGLE_FORMAT)
+
+static const char* counterNames[NUM_COUNTERS] = {"cycles", "instructions", "cache misses", "page faults",
+                                                 "context switches", "CPU migrations"};
+
+// Event type and config of every counter, in counterNames order
+static const unsigned counterTypes[NUM_COUNTERS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                                    PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE};
+static const unsigned long long counterConfigs[NUM_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_SW_PAGE_FAULTS, PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_CPU_MIGRATIONS};
+
+static pthread_once_t probeOnce = PTHREAD_ONCE_INIT;
+static int kernelCounting = 1;  // perf events may count kernel work
+
+const char* counterName(int counter) {
+    return counterNames[counter];
+}
+
+// Members of a group (groupFd != -1) start and stop with their leader
+static int openCounter(int counter, int excludeKernel, int groupFd, unsigned long long readFormat) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counterTypes[counter];
+    attr.config = counterConfigs[counter];
+    attr.disabled = groupFd == -1;
+    attr.exclude_kernel = excludeKernel;
+    attr.exclude_hv = 1;
+    attr.read_format = readFormat;
+
+    // pid 0, cpu -1: the calling thread on whatever CPU it runs
+    return syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+// perf_event_paranoid 2 and above refuses kernel counting to unprivileged
+// users, which shows as EACCES on any event that includes the kernel
+static void probeKernelCounting(void) {
+    int fd = openCounter(COUNTER_PAGE_FAULTS, 0, -1, 0);
+    kernelCounting = fd != -1 || errno != EACCES;
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+// Adds value extrapolated to the whole time the event was enabled
+static void addScaled(struct PerfCounters* counters, int counter, uint64_t value, uint64_t enabled, uint64_t running) {
+    // Never got a PMU slot, there is nothing to extrapolate from
+    if (running == 0) {
+        return;
+    }
+    if (running < enabled) {
+        value = (uint64_t)((double)value * enabled / running);
+        counters->scaled = 1;
+    }
+    counters->values[counter] += value;
+    counters->valid[counter] = 1;
+    counters->fromPerf = 1;
+}
+
+void countersInit(struct PerfCounters* counters) {
+    memset(counters, 0, sizeof(*counters));
+}
+
+// Starts counting for the calling thread. Counters the kernel refuses are
+// left out.
+void countersStart(struct CounterSession* session) {
+    pthread_once(&probeOnce, probeKernelCounting);
+    session->userOnly = !kernelCounting;
+    for (int i = 0; i < NUM_COUNTERS; ++i) {
+        session->fds[i] = -1;
+    }
+
+    // Members the PMU does not have are left out of the group
+    int leader = openCounter(COUNTER_CYCLES, session->userOnly, -1, GROUP_FORMAT);
+    session->fds[COUNTER_CYCLES] = leader;
+    for (int i = 1; leader != -1 && i < NUM_HARDWARE_COUNTERS; ++i) {
+        session->fds[i] = openCounter(i, session->userOnly, leader, GROUP_FORMAT);
+    }
+
+    // Software events excluding the kernel count nothing, the faults and
+    // switches happen there
+    int opened = 0;
+    for (int i = NUM_HARDWARE_COUNTERS; !session->userOnly && i < NUM_COUNTERS; ++i) {
+        session->fds[i] = openCounter(i, 0, -1, SINGLE_FORMAT);
+        opened += session->fds[i] != -1;
+    }
+    session->useRusage = opened == 0;
+    if (session->useRusage) {
+        getrusage(RUSAGE_THREAD, &session->usage);
+    }
+
+    if (leader != -1) {
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    for (int i = NUM_HARDWARE_COUNTERS; i < NUM_COUNTERS; ++i) {
+        if (session->fds[i] != -1) {
+            ioctl(session->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(session->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+// Stops counting and adds what was counted since countersStart() to counters
+void countersStop(struct CounterSession* session, struct PerfCounters* counters) {
+    int leader = session->fds[COUNTER_CYCLES];
+    if (leader != -1) {
+        ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        // Number of members, time enabled, time running, then the values in
+        // the order the members were opened
+        uint64_t group[3 + NUM_HARDWARE_COUNTERS];
+        if (read(leader, group, sizeof(group)) >= (ssize_t)(3 * sizeof(uint64_t))) {
+            uint64_t slot = 0;
+            for (int i = 0; i < NUM_HARDWARE_COUNTERS && slot < group[0]; ++i) {
+                if (session->fds[i] != -1) {
+                    addScaled(counters, i, group[3 + slot++], group[1], group[2]);
+                }
+            }
+        }
+        for (int i = NUM_HARDWARE_COUNTERS - 1; i >= 0; --i) {
+            if (session->fds[i] != -1) {
+                close(session->fds[i]);
+            }
+        }
+    }
+
+    for (int i = NUM_HARDWARE_COUNTERS; i < NUM_COUNTERS; ++i) {
+        if (session->fds[i] == -1) {
+            continue;
+        }
+        ioctl(session->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        uint64_t single[3];  // Value, time enabled, time running
+        if (read(session->fds[i], single, sizeof(single)) == sizeof(single)) {
+            addScaled(counters, i, single[0], single[1], single[2]);
+        }
+        close(session->fds[i]);
+    }
+
+    if (session->useRusage) {
+        struct rusage usage;
+        getrusage(RUSAGE_THREAD, &usage);
+        counters->values[COUNTER_PAGE_FAULTS] += (usage.ru_minflt - session->usage.ru_minflt) +
+                                                 (usage.ru_majflt - session->usage.ru_majflt);
+        counters->values[COUNTER_CONTEXT_SWITCHES] += (usage.ru_nvcsw - session->usage.ru_nvcsw) +
+                                                      (usage.ru_nivcsw - session->usage.ru_nivcsw);
+        counters->valid[COUNTER_PAGE_FAULTS] = 1;
+        counters->valid[COUNTER_CONTEXT_SWITCHES] = 1;
+        counters->fromRusage = 1;
+    }
+    counters->userOnly |= session->userOnly;
+}
+
+void countersAdd(struct PerfCounters* total, const struct PerfCounters* counters) {
+    for (int i = 0; i < NUM_COUNTERS; ++i) {
+        total->values[i] += counters->values[i];
+        total->valid[i] |= counters->valid[i];
+    }
+    total->fromPerf |= counters->fromPerf;
+    total->fromRusage |= counters->fromRusage;
+    total->userOnly |= counters->userOnly;
+    total->scaled |= counters->scaled;
+}
+
+// Prints every counter that was available, per block read
+void printCounters(const struct PerfCounters* counters, long long blocks) {
+    const char* perf = counters->userOnly ? "perf, user space only" : "perf";
+    if (counters->fromPerf && counters->fromRusage) {
+        printf("Counters (%s, faults and switches from getrusage%s):", perf, counters->scaled ? ", scaled" : "");
+    } else if (counters->fromPerf) {
+        printf("Counters (%s%s):", perf, counters->scaled ? ", scaled" : "");
+    } else if (counters->fromRusage) {
+        printf("Counters (getrusage):");
+    } else {
+        printf("Counters: none available\n");
+        return;
+    }
+
+    int printed = 0;
+    for (int i = 0; i < NUM_COUNTERS; ++i) {
+        if (counters->valid[i]) {
+            printf("%s %s %lld (%.2f/block)", printed++ ? "," : "", counterNames[i], counters->values[i],
+                   blocks > 0 ? (double)counters->values[i] / blocks : 0.0);
+        }
+    }
+    if (counters->valid[COUNTER_CYCLES] && counters->valid[COUNTER_INSTRUCTIONS] && counters->values[COUNTER_CYCLES] > 0) {
+        printf(", IPC %.2f", (double)counters->values[COUNTER_INSTRUCTIONS] / counters->values[COUNTER_CYCLES]);
+    }
+    printf("\n");
+}
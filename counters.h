@@ -0,0 +1,55 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <sys/resource.h>
+
+// Hardware and software event counters around a timed region of the calling
+// thread. countersStart() opens them, countersStop() adds what was counted to
+// a PerfCounters total, so one total can collect several regions or threads.
+// The hardware counters are one perf group, so they are scheduled together
+// and their ratios hold even when the PMU is multiplexed; every perf value is
+// scaled by its enabled over running time. When the kernel only allows user
+// space counting (perf_event_paranoid 2 and above without privilege), or no
+// perf events at all, page faults and context switches come from getrusage()
+// deltas and CPU migrations are left out.
+
+#define COUNTER_CYCLES 0
+#define COUNTER_INSTRUCTIONS 1
+#define COUNTER_CACHE_MISSES 2
+#define COUNTER_PAGE_FAULTS 3
+#define COUNTER_CONTEXT_SWITCHES 4
+#define COUNTER_CPU_MIGRATIONS 5
+#define NUM_COUNTERS 6
+#define NUM_HARDWARE_COUNTERS 3  // The first counters, opened as one group
+
+// Counter totals of one or more timed regions
+struct PerfCounters {
+    long long values[NUM_COUNTERS];
+    int valid[NUM_COUNTERS];  // Counter could be opened and was scheduled
+    int fromPerf;    // Some values came from perf events
+    int fromRusage;  // Page faults and context switches came from getrusage()
+    int userOnly;    // Kernel work was not counted by the perf events
+    int scaled;      // Some perf values were extrapolated from a multiplexed share
+};
+
+// Counters open for the calling thread between countersStart() and countersStop()
+struct CounterSession {
+    int fds[NUM_COUNTERS];  // fds[COUNTER_CYCLES] leads the hardware group
+    int userOnly;
+    int useRusage;
+    struct rusage usage;
+};
+
+const char* counterName(int counter);
+
+void countersInit(struct PerfCounters* counters);
+void countersStart(struct CounterSession* session);
+void countersStop(struct CounterSession* session, struct PerfCounters* counters);
+
+// Adds the counters of another region or thread to total
+void countersAdd(struct PerfCounters* total, const struct PerfCounters* counters);
+
+// Prints every counter that was available, per block read
+void printCounters(const struct PerfCounters* counters, long long blocks);
+
+#endif
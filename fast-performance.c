@@ -1,24 +1,50 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <limits.h>
+#include <stdint.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <sys/mman.h>
-#include <time.h>
+#include "bufpool.h"
+#include "iocore.h"
+#include "counters.h"
+#include "membw.h"
+#include "pipeline.h"
+#include "sweep.h"
+#include "timing.h"
 #include <pthread.h>
-
-#define KILOBYTE 1024
-#define MEGABYTE (KILOBYTE * KILOBYTE)
-
-struct ThreadData {
-    const char* filename;
-    int block_size;
-    int block_count;
-    int useCache;
-    double totalTime;
-};
+#include <sched.h>
+
+#define ENGINE_SYNC 0
+#define ENGINE_URING 1
+#define ENGINE_PREADV 2
+#define MAX_QUEUE_DEPTHS 16
+
+#define MAX_SCALING_POINTS 32
+
+int readEngine = ENGINE_SYNC;  // Read engine selected with -e
+int directIO = 0;  // Run the O_DIRECT sweep, set with -d
+int verifyXOR = 0;  // Check the XOR against the scalar reference, set with -x
+int queueDepths[MAX_QUEUE_DEPTHS] = {1, 4, 16, 64};
+int numQueueDepths = 4;
+int vectorBlocks = 16;  // Blocks gathered per preadv() call, set with -v
+int pipelineTest = 0;  // Compare serial and pipelined read+XOR, set with -p
+int ringDepth = 8;  // Buffers in the pipeline ring, set with -r
+int ringBufferSize = 256 * KILOBYTE;  // Set in KiB with -b
+int computeWorkers = 1;  // Threads consuming the ring, set with -w
+int readerThreads = 4;  // Threads used by the multithreaded reader, set with -t
+int chunkStrategy = CHUNK_STATIC;  // Set with -s
+int chunkBlocks = 256;  // Blocks per dynamic chunk, set with -c
+int perfCounters = 0;  // Count events around every read loop, set with -P
+int scalingSweep = 0;  // Run the thread scaling sweep, set with -S
+int scalingThreads[MAX_SCALING_POINTS];  // Set with -T, empty for the default sweep
+int numScalingThreads = 0;
+int affinityPolicies[AFFINITY_SCATTER + 1] = {AFFINITY_COMPACT, AFFINITY_SCATTER, AFFINITY_NONE};  // Set with -a
+int numAffinityPolicies = 3;
+long memoryBudget = 0;  // Buffer bytes for the memory bandwidth calibration, set in MiB with -M
 
 void shuffleArray(int arr[], int n) {
     srand(time(NULL));
@@ -31,184 +57,165 @@ void shuffleArray(int arr[], int n) {
 }
 
 void printUsage() {
-    printf("Usage: ./fast <filename>\n");
+    printf("Usage: ./fast [-d] [-x] [-P] [-e sync|uring|preadv] [-q depth,depth,...] [-v blocks] [-t threads] [-s static|dynamic] [-c chunk_blocks] [-S] [-T threads,...] [-a none|compact|scatter,...] [-p] [-r ring_depth] [-b buffer_KiB] [-w workers] [-M MiB] <filename>\n");
 }
 
-void xorBuffer(char* buffer, int size) {
-    for (int i = 0; i < size; ++i) {
-        buffer[i] ^= 0xFF;  // adding a padding with xor to avoid overflows.
-    }
-}
+void printVectoredPerformance(const char* filename, int block_size, int block_count, int useCache) {
+    double totalDataSizeMB = (double)block_size * block_count / MEGABYTE;
+    struct VectoredStats stats;
+    struct LatencyHistogram hist;
 
-void clearDiskCache(const char* filename) {
-    int fd = open(filename, O_RDONLY);
-    if (fd == -1) {
-        perror("Error opening file for clearing caches");
-        exit(EXIT_FAILURE);
+    double totalTime = measureReadTimeVectored(filename, block_size, block_count, vectorBlocks, 0,
+                                               useCache ? READ_CACHED : READ_COLD, &hist, &stats, NULL);
+    if (totalTime < 0) {
+        printf("preadv x%d: not reported\n", vectorBlocks);
+    } else {
+        printf("preadv x%d: %.2f MiB/s, %lld syscalls\n", vectorBlocks, totalDataSizeMB / totalTime, stats.calls);
     }
 
-    // Advise the kernel about the expected access pattern (sequential)
-    if (posix_madvise(NULL, 0, MADV_SEQUENTIAL) == -1) {
-        perror("Error advising kernel");
-        exit(EXIT_FAILURE);
+    totalTime = measureReadTimeVectored(filename, block_size, block_count, vectorBlocks, 1,
+                                        useCache ? READ_CACHED : READ_COLD, &hist, &stats, NULL);
+    if (totalTime < 0) {
+        printf("preadv2 RWF_NOWAIT x%d: not reported\n", vectorBlocks);
+        return;
     }
-
-    close(fd);
+    printf("preadv2 RWF_NOWAIT x%d: %.2f MiB/s, %lld syscalls, batches cached %lld, partly cached %lld, missed %lld\n",
+           vectorBlocks, totalDataSizeMB / totalTime, stats.calls, stats.hits, stats.partial, stats.misses);
 }
 
-double measureReadTime(const char* filename, int block_size, int block_count, int useCache) {
-    int flags = O_RDONLY;
-    if (!useCache) {
-        // Clear disk cache before non-cached reads
-        clearDiskCache(filename);
-    }
+void printUringPerformance(const char* filename, int block_size, int block_count, int useCache) {
+    double totalDataSizeMB = (double)block_size * block_count / MEGABYTE;
 
-    int fd = open(filename, flags);
-    if (fd == -1) {
-        perror("Error opening file for reading");
-        exit(EXIT_FAILURE);
-    }
+    for (int i = 0; i < numQueueDepths; ++i) {
+        double totalTime = measureReadTimeUring(filename, block_size, block_count, queueDepths[i],
+                                                useCache ? READ_CACHED : READ_COLD, NULL);
+        if (totalTime < 0) {
+            printf("io_uring QD %d: not reported\n", queueDepths[i]);
+            continue;
+        }
 
-    // Allocate buffer
-    char* buffer = malloc(block_size);
-    if (buffer == NULL) {
-        perror("Error allocating buffer");
-        exit(EXIT_FAILURE);
+        printf("io_uring QD %d: %.2f MiB/s, %.0f IOPS\n", queueDepths[i],
+               totalDataSizeMB / totalTime, block_count / totalTime);
     }
+}
 
-    ssize_t bytesRead;
-
-    clock_t start, end;
-    double totalTime = 0;
-
-    for (int i = 0; i < block_count; ++i) {
-        start = clock();
-
-        bytesRead = read(fd, buffer, block_size);
-        if (!useCache) {
-            xorBuffer(buffer, block_size);
-        }
-
-        end = clock();
-        double elapsedTime = ((double)(end - start)) / CLOCKS_PER_SEC;
+// Parses a comma separated list of queue depths for -q
+void parseQueueDepths(const char* list) {
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", list);
 
-        if (bytesRead == -1) {
-            perror("Error reading from file");
+    numQueueDepths = 0;
+    for (char* token = strtok(copy, ","); token != NULL; token = strtok(NULL, ",")) {
+        int depth = atoi(token);
+        if (depth <= 0 || depth > 4096 || numQueueDepths == MAX_QUEUE_DEPTHS) {
+            fprintf(stderr, "Invalid queue depth list: %s\n", list);
             exit(EXIT_FAILURE);
         }
-
-        totalTime += elapsedTime;
+        queueDepths[numQueueDepths++] = depth;
     }
-
-    free(buffer);
-    close(fd);
-
-    return totalTime;
-}
-
-void printFileSize(int block_size, int block_count) {
-    double fileSizeKB = (double)block_size * block_count / KILOBYTE;
-    double fileSizeMB = fileSizeKB / KILOBYTE;
-
-    printf("Block Size : %d , Block count: %d blocks, %.2f KB, %.2f MB\n", block_size, block_count, fileSizeKB, fileSizeMB);
 }
 
-void printPerformance(const char* filename, int block_size, int block_count, int useCache) {
-    double totalTime = measureReadTime(filename, block_size, block_count, useCache);
-
-    // Calculate performance in MiB/s
-    double totalDataSizeMB = (double)block_size * block_count / MEGABYTE;
-    double performance = totalDataSizeMB / totalTime;
-
-    printf("Time taken to read (%s): %.2f seconds\n", (useCache ? "Cached" : "Non-cached"), totalTime);
-    printf("Performance: %.2f MiB/s\n", performance);
-}
-
-void* readThread(void* arg) {
-    struct ThreadData* data = (struct ThreadData*)arg;
-
-    int flags = O_RDONLY;
-    if (!data->useCache) {
-        clearDiskCache(data->filename);
-    }
-
-    int fd = open(data->filename, flags);
-    if (fd == -1) {
-        perror("Error opening file for reading");
-        exit(EXIT_FAILURE);
-    }
-
-    char* buffer = malloc(data->block_size);
-    if (buffer == NULL) {
-        perror("Error allocating buffer");
-        exit(EXIT_FAILURE);
-    }
-
-    ssize_t bytesRead;
-
-    clock_t start, end;
-
-    start = clock();
-
-    for (int i = 0; i < data->block_count; ++i) {
-        bytesRead = read(fd, buffer, data->block_size);
-        if (!data->useCache) {
-            xorBuffer(buffer, data->block_size);
-        }
+void parseScalingThreads(const char* list) {
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", list);
 
-        if (bytesRead == -1) {
-            perror("Error reading from file");
+    numScalingThreads = 0;
+    for (char* token = strtok(copy, ","); token != NULL; token = strtok(NULL, ",")) {
+        int threads = atoi(token);
+        if (threads <= 0 || threads > 4096 || numScalingThreads == MAX_SCALING_POINTS) {
+            fprintf(stderr, "Invalid thread count list: %s\n", list);
             exit(EXIT_FAILURE);
         }
+        scalingThreads[numScalingThreads++] = threads;
     }
-
-    end = clock();
-
-    free(buffer);
-    close(fd);
-
-    data->totalTime = ((double)(end - start)) / CLOCKS_PER_SEC;
-
-    return NULL;
 }
 
-double measureReadTimeMultithread(const char* filename, int block_size, int block_count, int useCache) {
-    int numThreads = 4; // Adjust the number of threads as needed
-
-    pthread_t threads[numThreads];
-    struct ThreadData data[numThreads];
+void parseAffinityPolicies(const char* list) {
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", list);
 
-    for (int i = 0; i < numThreads; ++i) {
-        data[i].filename = filename;
-        data[i].block_size = block_size;
-        data[i].block_count = block_count / numThreads;
-        data[i].useCache = useCache;
-        data[i].totalTime = 0.0;
-
-        pthread_create(&threads[i], NULL, readThread, &data[i]);
+    numAffinityPolicies = 0;
+    for (char* token = strtok(copy, ","); token != NULL; token = strtok(NULL, ",")) {
+        int policy = parseAffinity(token);
+        if (policy < 0 || numAffinityPolicies == AFFINITY_SCATTER + 1) {
+            fprintf(stderr, "Invalid affinity policy list: %s\n", list);
+            exit(EXIT_FAILURE);
+        }
+        affinityPolicies[numAffinityPolicies++] = policy;
     }
+}
 
-    for (int i = 0; i < numThreads; ++i) {
-        pthread_join(threads[i], NULL);
+// Reads the file at each thread count under each affinity policy and prints
+// throughput, speedup over the first thread count of the same policy and
+// parallel efficiency (speedup relative to linear scaling from that point).
+void runScalingSweep(const char* filename, int block_size, int useCache) {
+    struct stat fileStat;
+    if (stat(filename, &fileStat) == -1) {
+        perror("Error getting file information");
+        exit(EXIT_FAILURE);
     }
+    int block_count = fileStat.st_size / block_size;
+    double totalDataSizeMB = (double)block_size * block_count / MEGABYTE;
 
-    double totalTime = 0.0;
-    for (int i = 0; i < numThreads; ++i) {
-        totalTime += data[i].totalTime;
+    // Default: powers of two up to the online CPUs, then 2x and 4x oversubscribed
+    if (numScalingThreads == 0) {
+        int online = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int threads = 1; threads < online; threads *= 2) {
+            scalingThreads[numScalingThreads++] = threads;
+        }
+        scalingThreads[numScalingThreads++] = online;
+        scalingThreads[numScalingThreads++] = 2 * online;
+        scalingThreads[numScalingThreads++] = 4 * online;
+    }
+
+    printf("Block Size : %d, %s, %s\n\n", block_size, useCache ? "cached" : "non-cached",
+           chunkStrategy == CHUNK_STATIC ? "static ranges" : "dynamic chunks");
+    printf("Affinity\tThreads\tMiB/s\t\tSpeedup\tEfficiency%s\n", memoryCalibrated() ? "\tOf memcpy" : "");
+
+    static int cpus[CPU_SETSIZE];
+    for (int p = 0; p < numAffinityPolicies; ++p) {
+        int policy = affinityPolicies[p];
+        int numCpus = policy == AFFINITY_NONE ? 0 : affinityOrder(policy, cpus);
+        double baseline = 0.0;
+        int baselineThreads = 0;
+
+        for (int i = 0; i < numScalingThreads; ++i) {
+            int threads = scalingThreads[i];
+
+            struct ThreadSkew skew;
+            double totalTime = measureReadTimeParallel(filename, block_size, block_count, threads, chunkStrategy,
+                                                       chunkBlocks, useCache ? READ_CACHED : READ_COLD, &skew, NULL,
+                                                       numCpus ? cpus : NULL, numCpus);
+            if (totalTime < 0) {
+                printf("%s\t\t%d\tnot reported, file is not cold\n", affinityName(policy), threads);
+                continue;
+            }
+
+            double performance = totalDataSizeMB / totalTime;
+            if (baseline == 0.0) {
+                baseline = performance;
+                baselineThreads = threads;
+            }
+            double speedup = performance / baseline;
+
+            printf("%s\t\t%d\t%.2f\t\t%.2fx\t%.1f%%", affinityName(policy), threads, performance, speedup,
+                   100.0 * speedup * baselineThreads / threads);
+            if (memoryCalibrated()) {
+                printf("\t\t%.1f%%", 100 * memoryFraction(performance, threads));
+            }
+            printf("\n");
+        }
     }
-
-    return totalTime;
+    printf("\n");
 }
 
 int printPerformanceMultithread(const char* filename, int useCache) {
-    int blockSizes[] = {512, 1024, 1028, 1400, 1424, 1600, 1720, 1800, 2000, 2048, 2400};
-    int numBlockSizes = sizeof(blockSizes) / sizeof(blockSizes[0]);
-
     if (useCache) {
         printf("\nBlock Size\tCached Performance (MiB/s)\n\n");
     } else {
         printf("\nBlock Size\tNon-cached Performance (MiB/s)\n\n");
     }
+    printf("Threads: %d, %s\n\n", readerThreads, chunkStrategy == CHUNK_STATIC ? "static ranges" : "dynamic chunks");
 
     struct stat fileStat;
     if (stat(filename, &fileStat) == -1) {
@@ -219,18 +226,33 @@ int printPerformanceMultithread(const char* filename, int useCache) {
     int bestBlockSize = 0;
     double bestPerformance = 0.0;
 
-    for (int i = 0; i < numBlockSizes; ++i) {
-        int block_size = blockSizes[i];
+    for (int i = 0; i < numDefaultBlockSizes; ++i) {
+        int block_size = defaultBlockSizes[i];
         int block_count = fileStat.st_size / block_size;
 
-        double totalTime = measureReadTimeMultithread(filename, block_size, block_count, useCache);
+        struct ThreadSkew skew;
+        struct PerfCounters counters;
+        double totalTime = measureReadTimeParallel(filename, block_size, block_count, readerThreads, chunkStrategy,
+                                                   chunkBlocks, useCache ? READ_CACHED : READ_COLD, &skew,
+                                                   perfCounters ? &counters : NULL, NULL, 0);
+        if (totalTime < 0) {
+            printf("Block Size : %d , Block count: %d blocks\n", block_size, block_count);
+            printf("Performance: not reported, file is not cold\n\n\n");
+            continue;
+        }
 
         // Calculate performance in MiB/s
         double totalDataSizeMB = (double)block_size * block_count / MEGABYTE;
         double performance = totalDataSizeMB / totalTime;
 
         printf("Block Size : %d , Block count: %d blocks\n", block_size, block_count);
-        printf("Performance: %.2f MiB/s\n", performance);
+        printf("Performance: %.2f MiB/s (wall-clock, %.3f seconds)\n", performance, totalTime);
+        printMemoryFraction(performance, readerThreads);
+        printf("Thread skew: fastest %.3f s, slowest %.3f s (%.1f%%)\n", skew.fastest, skew.slowest,
+               skew.slowest > 0 ? (skew.slowest - skew.fastest) / skew.slowest * 100 : 0.0);
+        if (perfCounters) {
+            printCounters(&counters, block_count);
+        }
         printf("\n\n");
 
         // Update best block size based on performance
@@ -243,36 +265,10 @@ int printPerformanceMultithread(const char* filename, int useCache) {
     return bestBlockSize;
 }
 
-void runTestCases(const char* filename, int useCache) {
-    int blockSizes[] = {512, 1024, 1028, 1400, 1424,1600, 1720, 1800, 2000, 2048, 2400};
-    int numBlockSizes = sizeof(blockSizes) / sizeof(blockSizes[0]);
-
-    if (useCache) {
-        printf("\nBlock Size\tCached Performance (MiB/s)\n\n");
-    } else {
-        printf("\nBlock Size\tNon-cached Performance (MiB/s)\n\n");
-    }
-
-    struct stat fileStat;
-    if (stat(filename, &fileStat) == -1) {
-        perror("Error getting file information");
-        exit(EXIT_FAILURE);
-    }
-
-    for (int i = 0; i < numBlockSizes; ++i) {
-        int block_size = blockSizes[i];
-        int block_count = fileStat.st_size / block_size;
-
-        // Perform test case
-        printFileSize(block_size, block_count);
-        printPerformance(filename, block_size, block_count, useCache);
-        printf("\n\n");
-    }
-}
-
 void runPerformanceTest(const char* filename, int useCache) {
-    int blockSizes[] = {512, 1024, 1028, 1400, 1424,1600, 1720, 1800, 2000, 2048, 2400};
-    int numBlockSizes = sizeof(blockSizes) / sizeof(blockSizes[0]);
+    int numBlockSizes = numDefaultBlockSizes;
+    int blockSizes[numBlockSizes];
+    memcpy(blockSizes, defaultBlockSizes, sizeof(blockSizes));
     shuffleArray(blockSizes, numBlockSizes);
     double bestPerformance = 0.0;
     int bestBlockSize = 0;
@@ -288,16 +284,34 @@ void runPerformanceTest(const char* filename, int useCache) {
         int block_count = fileStat.st_size / block_size;
 
         // Perform test case
-        double totalTime = measureReadTime(filename, block_size, block_count, useCache);
+        struct LatencyHistogram hist;
+        struct PerfCounters counters;
+        double totalTime = measureReadTime(filename, block_size, block_count, useCache ? READ_CACHED : READ_COLD,
+                                           NULL, &hist, perfCounters ? &counters : NULL);
+
+        // Print results for each block size
+        printFileSize(block_size, block_count);
+        if (totalTime < 0) {
+            printf("Performance: not reported, file is not cold\n\n");
+            continue;
+        }
 
         // Calculate performance in MiB/s
         double totalDataSizeMB = (double)block_size * block_count / MEGABYTE;
         double performance = totalDataSizeMB / totalTime;
 
-        // Print results for each block size
-        printFileSize(block_size, block_count);
         printf("Time taken to read (%s): %.2f seconds\n", (useCache ? "Cached" : "Non-cached"), totalTime);
-        printf("Performance: %.2f MiB/s\n", performance);
+        printf("Performance: %.2f MiB/s, %.0f IOPS\n", performance, block_count / totalTime);
+        printMemoryFraction(performance, 1);
+        histPrint(&hist);
+        if (perfCounters) {
+            printCounters(&counters, block_count);
+        }
+        if (readEngine == ENGINE_URING) {
+            printUringPerformance(filename, block_size, block_count, useCache);
+        } else if (readEngine == ENGINE_PREADV) {
+            printVectoredPerformance(filename, block_size, block_count, useCache);
+        }
         printf("\n");
 
         // Update best performance block size
@@ -312,119 +326,127 @@ void runPerformanceTest(const char* filename, int useCache) {
     printf("Best Performance: %.2f MiB/s\n\n", bestPerformance);
 }
 
-void runGenericTest(const char* filename) {
-    int blockSizes[] = {512, 1024, 1028, 1400, 1424,1600, 1720, 1800, 2000, 2048, 2400};
-    int numBlockSizes = sizeof(blockSizes) / sizeof(blockSizes[0]);
-    shuffleArray(blockSizes, numBlockSizes);
-    double bestPerformance = 0.0;
-    int bestBlockSize = 0;
-
-    struct stat fileStat;
-    if (stat(filename, &fileStat) == -1) {
-        perror("Error getting file information");
-        exit(EXIT_FAILURE);
-    }
-
-    for (int i = 0; i < numBlockSizes; ++i) {
-        int block_size = blockSizes[i];
-        int block_count = fileStat.st_size / block_size;
-
-        // Perform test case
-        double totalTimeCached = measureReadTime(filename, block_size, block_count, 1);
-        double totalTimeNonCached = measureReadTime(filename, block_size, block_count, 0);
-
-        // Calculate average performance in MiB/s
-        double totalDataSizeMB = (double)block_size * block_count / MEGABYTE;
-        double performanceCached = totalDataSizeMB / totalTimeCached;
-        double performanceNonCached = totalDataSizeMB / totalTimeNonCached;
-        double averagePerformance = (performanceCached + performanceNonCached) / 2;
-
-        // Print results for each block size
-        printFileSize(block_size, block_count);
-        printf("Cached Performance: %.2f MiB/s\n", performanceCached);
-        printf("Non-cached Performance: %.2f MiB/s\n", performanceNonCached);
-        printf("Average Performance: %.2f MiB/s\n", averagePerformance);
-        printf("\n");
-
-        // Update best performance block size
-        if (averagePerformance > bestPerformance) {
-            bestPerformance = averagePerformance;
-            bestBlockSize = block_size;
-        }
-    }
-
-    // Print the best performance block size for the generic test
-    printf("Best Performance Block Size (Generic Test): %d\n", bestBlockSize);
-    printf("Best Performance: %.2f MiB/s\n\n", bestPerformance);
+// The file checksum is the XOR of the file taken as little-endian 64-bit
+// words, with the last partial word padded with zeros. Folding the two halves
+// gives the XOR of 32-bit words, so both widths come from the same value.
+unsigned int foldXOR32(uint64_t value) {
+    return (unsigned int)(value ^ (value >> 32));
 }
 
 
-void findXORValue(const char* filename, int finalBlockSize, int maxRetries) {
-    int fd = open(filename, O_RDONLY);
-    if (fd == -1) {
-        perror("Error opening file for XOR calculation");
-        exit(EXIT_FAILURE);
-    }
-
-    ssize_t bytesRead;
-    unsigned char buffer[1024];  // Adjust buffer size as needed
-
-    // Initialize XOR result
-    int xorResult = 0;
-
-    while ((bytesRead = read(fd, buffer, sizeof(buffer))) > 0) {
-        // Update XOR result with offset adjustment
-        for (ssize_t i = 0; i < bytesRead; ++i) {
-            xorResult ^= buffer[i]; // Adjusting the offset by 1 as we added padding.
+int main(int argc, char* argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "dxPSe:q:v:t:s:c:pr:b:w:T:a:M:")) != -1) {
+        switch (opt) {
+            case 'e':
+                if (strcmp(optarg, "uring") == 0) {
+                    readEngine = ENGINE_URING;
+                } else if (strcmp(optarg, "preadv") == 0) {
+                    readEngine = ENGINE_PREADV;
+                } else if (strcmp(optarg, "sync") == 0) {
+                    readEngine = ENGINE_SYNC;
+                } else {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'q':
+                parseQueueDepths(optarg);
+                break;
+            case 'v':
+                if ((vectorBlocks = atoi(optarg)) <= 0 || vectorBlocks > IOV_MAX) {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'd':
+                directIO = 1;
+                break;
+            case 'p':
+                pipelineTest = 1;
+                break;
+            case 'r':
+                if ((ringDepth = atoi(optarg)) <= 0) {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'b':
+                if ((ringBufferSize = atoi(optarg) * KILOBYTE) <= 0) {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'w':
+                if ((computeWorkers = atoi(optarg)) <= 0) {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'M':
+                if ((memoryBudget = atol(optarg) * MEGABYTE) <= 0) {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'x':
+                verifyXOR = 1;
+                break;
+            case 'P':
+                perfCounters = 1;
+                break;
+            case 'S':
+                scalingSweep = 1;
+                break;
+            case 'T':
+                parseScalingThreads(optarg);
+                break;
+            case 'a':
+                parseAffinityPolicies(optarg);
+                break;
+            case 't':
+                if ((readerThreads = atoi(optarg)) <= 0) {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's':
+                if (strcmp(optarg, "static") == 0) {
+                    chunkStrategy = CHUNK_STATIC;
+                } else if (strcmp(optarg, "dynamic") == 0) {
+                    chunkStrategy = CHUNK_DYNAMIC;
+                } else {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'c':
+                if ((chunkBlocks = atoi(optarg)) <= 0) {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                printUsage();
+                return EXIT_FAILURE;
         }
     }
 
-    if (bytesRead == -1) {
-        perror("Error reading from file for XOR calculation");
-        exit(EXIT_FAILURE);
-    }
-
-    close(fd);
-
-    if (xorResult == 0 && maxRetries > 0) {
-        fprintf(stderr, "Warning: XOR result is zero. Check file content and block size. Retrying...\n");
-
-        // Retry XOR calculation recursively with reduced maxRetries
-        findXORValue(filename, finalBlockSize, maxRetries - 1);
-        return;  // Exit the function to avoid printing XOR value multiple times
-    }
-
-    printf("XOR Value for the file with Block Size %d: %08x\n", finalBlockSize, xorResult);
-}
-
-
-
-unsigned int xorFile(const char *filename) {
-    FILE *file = fopen(filename, "rb");
-    if (file == NULL) {
-        perror("Error opening file for reading");
-        exit(EXIT_FAILURE);
+    if (argc - optind != 1) {
+        printUsage();
+        return EXIT_FAILURE;
     }
 
-    unsigned int result = 0;
-    unsigned int buffer;
-
-    while (fread(&buffer, sizeof(unsigned int), 1, file) == 1) {
-        result ^= buffer;
+    const char* filename = argv[optind];
+    timingInit();
+    if (memoryBudget > 0) {
+        struct BandwidthPoint points[MEMBW_MAX_POINTS];
+        printMemoryCalibration(points, memoryCalibrate(memoryBudget, points));
     }
 
-    fclose(file);
-    return result;
-}
-
-
-int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        printUsage();
-        return EXIT_FAILURE;
+    if (readEngine == ENGINE_URING && !uringAvailable()) {
+        readEngine = ENGINE_SYNC;
     }
-
-    const char* filename = argv[1];
     int bestBlockSizeCached = 0;
     int bestBlockSizeUncached = 0;
     
@@ -434,6 +456,19 @@ int main(int argc, char* argv[]) {
 
     printf("\nTest case to find the best performance block size for Non-cached Reads:\n");
     runPerformanceTest(filename, 0);
+
+    if (directIO) {
+        printf("\nTest case to find the performance for different block sizes with O_DIRECT:\n");
+        runDirectTestCases(filename);
+    }
+
+    if (pipelineTest) {
+        printf("\nRead/compute pipeline with Cache:\n");
+        runPipelineTest(filename, ringBufferSize, ringDepth, computeWorkers, 1);
+
+        printf("\nRead/compute pipeline Without Cache:\n");
+        runPipelineTest(filename, ringBufferSize, ringDepth, computeWorkers, 0);
+    }
     
     printf("\n\n Let's move ahead and run multiple threads!!!\n\n");
     
@@ -452,20 +487,41 @@ int main(int argc, char* argv[]) {
         printf("\nOverall the best Block Size is %d \n", bestBlockSizeUncached);
         finalBlockSize = bestBlockSizeUncached;
     }
+
+    if (scalingSweep) {
+        printf("\nThread scaling with Cache:\n");
+        runScalingSweep(filename, finalBlockSize, 1);
+
+        printf("\nThread scaling Without Cache:\n");
+        runScalingSweep(filename, finalBlockSize, 0);
+    }
     
     
-    printf("\n\n Let's move ahead and find the XOR Value using the Best Block Size !!!\n\n");
-    
-    findXORValue(filename, finalBlockSize,4);
-    
-    
-    printf("\n\n Let's find the XOR Value directly with default buffer size !!!\n\n");
-    
-     unsigned int result = xorFile(filename);
+    printf("\n\n Let's move ahead and find the XOR Value of the file !!!\n\n");
 
-    printf("XOR Value for the entire file: %08x\n", result);
-    
+    const char* kernelName;
+    uint64_t start = timingNow();
+    uint64_t result = xorChecksum(filename, readerThreads, &kernelName);
+    double xorTime = timingElapsed(start, timingNow()) / 1e9;
 
+    struct stat fileStat;
+    if (stat(filename, &fileStat) == -1) {
+        perror("Error getting file information");
+        exit(EXIT_FAILURE);
+    }
+    printf("XOR computed with %s kernel on %d threads: %.2f MiB/s\n", kernelName, readerThreads,
+           (double)fileStat.st_size / MEGABYTE / xorTime);
+
+    printf("XOR Value for the entire file: %016llx (32-bit: %08x)\n", (unsigned long long)result, foldXOR32(result));
+
+    if (verifyXOR) {
+        uint64_t reference = xorChecksumReference(filename);
+        if (reference != result) {
+            fprintf(stderr, "XOR mismatch: scalar reference gives %016llx\n", (unsigned long long)reference);
+            return EXIT_FAILURE;
+        }
+        printf("Matches the scalar reference\n");
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,2517 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <linux/io_uring.h>
+#include "bufpool.h"
+#include "iocore.h"
+
+const int defaultBlockSizes[] = {512, 1024, 1028, 1400, 1424, 1600, 1720, 1800, 2000, 2048, 2400};
+const int numDefaultBlockSizes = sizeof(defaultBlockSizes) / sizeof(defaultBlockSizes[0]);
+
+// Parses a comma separated list of positive integers. Returns the number of
+// values, or -1 if the list is malformed or too long.
+int parseIntList(const char* list, int* values, int maxValues) {
+    int count = 0;
+    const char* p = list;
+
+    while (*p) {
+        char* end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value <= 0 || value > 0x7fffffff || count == maxValues) {
+            return -1;
+        }
+        values[count++] = value;
+
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+        p = end;
+    }
+
+    return count;
+}
+
+// Calls parse on every token of a comma separated list with the token's
+// position. Returns the number of tokens, or -1 if parse returns 0 for one or
+// there are more than maxValues.
+int parseList(const char* list, int maxValues, int (*parse)(const char* token, int index, void* context),
+              void* context) {
+    char* copy = strdup(list);
+    if (copy == NULL) {
+        perror("Error allocating buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    int count = 0;
+    char* state;
+    for (char* token = strtok_r(copy, ",", &state); token != NULL; token = strtok_r(NULL, ",", &state)) {
+        if (count == maxValues || !parse(token, count, context)) {
+            count = -1;
+            break;
+        }
+        count++;
+    }
+
+    free(copy);
+    return count;
+}
+
+// Parses a decimal integer between min and max with nothing after it.
+// Returns 0 if text is not one.
+int parseInteger(const char* text, long long min, long long max, long long* value) {
+    char* end;
+    errno = 0;
+    long long parsed = strtoll(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < min || parsed > max) {
+        return 0;
+    }
+    *value = parsed;
+    return 1;
+}
+
+const char* readModeName(int mode) {
+    switch (mode) {
+        case READ_CACHED: return "cached";
+        case READ_COLD: return "cold";
+        case READ_DIRECT: return "direct";
+    }
+    return "unknown";
+}
+
+int parseReadMode(const char* name) {
+    for (int mode = READ_CACHED; mode <= READ_DIRECT; ++mode) {
+        if (strcmp(name, readModeName(mode)) == 0) {
+            return mode;
+        }
+    }
+    return -1;
+}
+
+const char* affinityName(int policy) {
+    switch (policy) {
+        case AFFINITY_NONE: return "none";
+        case AFFINITY_COMPACT: return "compact";
+        case AFFINITY_SCATTER: return "scatter";
+    }
+    return "unknown";
+}
+
+int parseAffinity(const char* name) {
+    for (int policy = AFFINITY_NONE; policy <= AFFINITY_SCATTER; ++policy) {
+        if (strcmp(name, affinityName(policy)) == 0) {
+            return policy;
+        }
+    }
+    return -1;
+}
+
+const char* writeModeName(int mode) {
+    switch (mode) {
+        case WRITE_BUFFERED: return "buffered";
+        case WRITE_DIRECT: return "direct";
+        case WRITE_DSYNC: return "dsync";
+    }
+    return "unknown";
+}
+
+int parseWriteMode(const char* name) {
+    for (int mode = WRITE_BUFFERED; mode <= WRITE_DSYNC; ++mode) {
+        if (strcmp(name, writeModeName(mode)) == 0) {
+            return mode;
+        }
+    }
+    return -1;
+}
+
+static const char* syncKindNames[] = {"none", "fsync", "fdatasync", "pipeline"};
+
+// Parses none, fsync[:N], fdatasync[:N] or pipeline[:N]. Returns 0 if the
+// name is not a valid policy.
+int parseSyncPolicy(const char* name, struct SyncPolicy* policy) {
+    for (int kind = SYNC_NONE; kind <= SYNC_PIPELINE; ++kind) {
+        size_t length = strlen(syncKindNames[kind]);
+        if (strncmp(name, syncKindNames[kind], length) != 0) {
+            continue;
+        }
+
+        policy->kind = kind;
+        policy->everyBlocks = kind == SYNC_PIPELINE ? PIPELINE_DEFAULT_BLOCKS : 0;
+        if (name[length] == '\0') {
+            return 1;
+        }
+        if (name[length] != ':' || kind == SYNC_NONE) {
+            return 0;
+        }
+
+        char* end;
+        long every = strtol(name + length + 1, &end, 10);
+        if (*end != '\0' || every <= 0 || every > 0x7fffffff) {
+            return 0;
+        }
+        policy->everyBlocks = every;
+        return 1;
+    }
+    return 0;
+}
+
+void syncPolicyName(const struct SyncPolicy* policy, char* name, size_t size) {
+    if (policy->kind == SYNC_NONE) {
+        snprintf(name, size, "none");
+    } else if (policy->everyBlocks == 0) {
+        snprintf(name, size, "%s:end", syncKindNames[policy->kind]);
+    } else {
+        snprintf(name, size, "%s:%d", syncKindNames[policy->kind], policy->everyBlocks);
+    }
+}
+
+long long fileSize(const char* filename) {
+    struct stat fileStat;
+    if (stat(filename, &fileStat) == -1) {
+        perror("Error getting file information");
+        exit(EXIT_FAILURE);
+    }
+    return fileStat.st_size;
+}
+
+// Returns the fraction of the file's pages that are in the page cache
+double fileResidency(int fd) {
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == -1) {
+        perror("Error getting file information");
+        exit(EXIT_FAILURE);
+    }
+    if (fileStat.st_size == 0) {
+        return 0.0;
+    }
+
+    // Mapping the file does not fault pages in, so mincore() sees the cache as it is
+    void* map = mmap(NULL, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Error mapping file for residency check");
+        exit(EXIT_FAILURE);
+    }
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    size_t numPages = (fileStat.st_size + pageSize - 1) / pageSize;
+    unsigned char* vec = malloc(numPages);
+    if (vec == NULL) {
+        perror("Error allocating residency vector");
+        exit(EXIT_FAILURE);
+    }
+
+    if (mincore(map, fileStat.st_size, vec) == -1) {
+        perror("Error checking page residency");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t resident = 0;
+    for (size_t i = 0; i < numPages; ++i) {
+        resident += vec[i] & 1;
+    }
+
+    free(vec);
+    munmap(map, fileStat.st_size);
+
+    return (double)resident / numPages;
+}
+
+// Evicts the file from the page cache and returns the fraction of its pages
+// still resident afterwards.
+double clearDiskCache(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("Error opening file for clearing caches");
+        exit(EXIT_FAILURE);
+    }
+
+    double residency = 1.0;
+    for (int attempt = 0; attempt < EVICT_ATTEMPTS && residency > MAX_COLD_RESIDENCY; ++attempt) {
+        // Dirty pages are skipped by DONTNEED, so write them back first
+        if (fdatasync(fd) == -1) {
+            perror("Error syncing file before clearing caches");
+            exit(EXIT_FAILURE);
+        }
+
+        int ret = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        if (ret != 0) {
+            fprintf(stderr, "Error advising kernel: %s\n", strerror(ret));
+            exit(EXIT_FAILURE);
+        }
+
+        residency = fileResidency(fd);
+    }
+
+    close(fd);
+
+    return residency;
+}
+
+// Prepares the page cache for a timed run. Cold runs are refused (returns 0)
+// when the file could not be evicted below MAX_COLD_RESIDENCY.
+int prepareCache(const char* filename, int mode) {
+    if (mode != READ_COLD) {
+        return 1;
+    }
+
+    double residency = clearDiskCache(filename);
+    if (residency > MAX_COLD_RESIDENCY) {
+        fprintf(stderr, "Cache eviction failed: %.1f%% of %s still resident, not reporting\n",
+                residency * 100, filename);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Direct I/O alignment of the file from statx(STATX_DIOALIGN). Kernels that
+// do not report it get the preferred I/O size for offsets, which is always a
+// valid multiple, and for memory the logical block size they required then,
+// which a page always satisfies. memAlign is at least sizeof(void*) so it
+// can go to posix_memalign(). Returns 0 if the filesystem does not support
+// O_DIRECT at all.
+int directIOAlignment(const char* filename, int* memAlign, int* offsetAlign) {
+    struct statx fileStatx;
+    if (statx(AT_FDCWD, filename, 0, STATX_DIOALIGN, &fileStatx) == -1) {
+        perror("Error getting file information");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!(fileStatx.stx_mask & STATX_DIOALIGN)) {
+        *memAlign = fileStatx.stx_blksize < BUFFER_ALIGN ? fileStatx.stx_blksize : BUFFER_ALIGN;
+        *offsetAlign = fileStatx.stx_blksize;
+    } else {
+        *memAlign = fileStatx.stx_dio_mem_align;
+        *offsetAlign = fileStatx.stx_dio_offset_align;
+        if (*memAlign == 0 || *offsetAlign == 0) {
+            return 0;
+        }
+    }
+
+    if (*memAlign < (int)sizeof(void*)) {
+        *memAlign = sizeof(void*);
+    }
+    return 1;
+}
+
+// Pool buffers are BUFFER_ALIGN aligned, which is enough for O_DIRECT unless
+// the filesystem asks for more. Prints why and returns 0 in that case.
+static int directBuffersAligned(const char* filename) {
+    int memAlign, offsetAlign;
+    if (directIOAlignment(filename, &memAlign, &offsetAlign) && memAlign > BUFFER_ALIGN) {
+        fprintf(stderr, "Direct I/O on %s needs %d byte aligned buffers, the buffer pool aligns to %d\n", filename,
+                memAlign, BUFFER_ALIGN);
+        return 0;
+    }
+    return 1;
+}
+
+// Rounds a block size up to the next multiple of the direct I/O alignment
+int roundToAlignment(int block_size, int align) {
+    return (block_size + align - 1) / align * align;
+}
+
+static int openForMode(const char* filename, int mode) {
+    if (mode == READ_DIRECT && !directBuffersAligned(filename)) {
+        return -1;
+    }
+
+    int fd = open(filename, O_RDONLY | (mode == READ_DIRECT ? O_DIRECT : 0));
+    if (fd == -1) {
+        perror(mode == READ_DIRECT ? "Error opening file for direct reading" : "Error opening file for reading");
+    }
+    return fd;
+}
+
+static const char* readaheadKindNames[] = {"kernel", "sequential", "random", "noreuse", "willneed", "readahead", "prefetch"};
+
+// Parses one of readaheadKindNames, with :MiB for the window of readahead
+// and prefetch. Returns 0 if the name is not a valid policy.
+int parseReadaheadPolicy(const char* name, struct ReadaheadPolicy* policy) {
+    for (int kind = READAHEAD_KERNEL; kind <= READAHEAD_PREFETCH; ++kind) {
+        size_t length = strlen(readaheadKindNames[kind]);
+        if (strncmp(name, readaheadKindNames[kind], length) != 0 || (name[length] != '\0' && name[length] != ':')) {
+            continue;
+        }
+
+        policy->kind = kind;
+        policy->window = READAHEAD_DEFAULT_WINDOW;
+        if (name[length] == '\0') {
+            return 1;
+        }
+        if (kind != READAHEAD_EXPLICIT && kind != READAHEAD_PREFETCH) {
+            return 0;
+        }
+
+        char* end;
+        long long window = strtoll(name + length + 1, &end, 10);
+        if (*end != '\0' || window <= 0) {
+            return 0;
+        }
+        policy->window = window * MEGABYTE;
+        return 1;
+    }
+    return 0;
+}
+
+void readaheadPolicyName(const struct ReadaheadPolicy* policy, char* name, size_t size) {
+    if (policy->kind == READAHEAD_EXPLICIT || policy->kind == READAHEAD_PREFETCH) {
+        snprintf(name, size, "%s:%lld", readaheadKindNames[policy->kind], policy->window / MEGABYTE);
+    } else {
+        snprintf(name, size, "%s", readaheadKindNames[policy->kind]);
+    }
+}
+
+// Background prefetcher that keeps readahead() a window ahead of the reader
+struct Prefetcher {
+    int fd;
+    long long window;
+    long long end;            // File bytes the reader will consume
+    long long readerOffset;   // Published by the reader after every block
+    int stop;
+};
+
+static void* prefetchThread(void* arg) {
+    struct Prefetcher* prefetcher = (struct Prefetcher*)arg;
+    long long chunk = prefetcher->window / 4 > 0 ? prefetcher->window / 4 : prefetcher->window;
+    long long fetched = 0;
+
+    while (!__atomic_load_n(&prefetcher->stop, __ATOMIC_ACQUIRE) && fetched < prefetcher->end) {
+        long long target = __atomic_load_n(&prefetcher->readerOffset, __ATOMIC_ACQUIRE) + prefetcher->window;
+        if (fetched >= target) {
+            // Ahead by a full window, give the reader time to catch up
+            struct timespec pause = {0, 50000};
+            nanosleep(&pause, NULL);
+            continue;
+        }
+
+        long long length = fetched + chunk <= prefetcher->end ? chunk : prefetcher->end - fetched;
+        readahead(prefetcher->fd, fetched, length);
+        fetched += length;
+    }
+
+    return NULL;
+}
+
+// Reads block_count blocks sequentially with read(), timing each call, under
+// a readahead policy (NULL for the kernel default). Advice and explicit
+// readahead() calls are charged to the read they precede; the prefetcher
+// runs on its own thread and is not counted in counters. Returns the time
+// spent reading, or -1 if the run cannot be reported.
+double measureReadTime(const char* filename, int block_size, long long block_count, int mode,
+                       const struct ReadaheadPolicy* policy, struct LatencyHistogram* hist,
+                       struct PerfCounters* counters) {
+    if (!prepareCache(filename, mode)) {
+        return -1;
+    }
+
+    int fd = openForMode(filename, mode);
+    if (fd == -1) {
+        return -1;
+    }
+
+    char* buffer = poolAcquire(block_size);
+    ssize_t bytesRead;
+    int kind = policy != NULL ? policy->kind : READAHEAD_KERNEL;
+    long long totalBytes = (long long)block_size * block_count;
+    long long readaheadEnd = 0;
+
+    struct Prefetcher prefetcher;
+    pthread_t prefetchId;
+    if (kind == READAHEAD_PREFETCH) {
+        memset(&prefetcher, 0, sizeof(prefetcher));
+        prefetcher.fd = fd;
+        prefetcher.window = policy->window;
+        prefetcher.end = totalBytes;
+        if (pthread_create(&prefetchId, NULL, prefetchThread, &prefetcher) != 0) {
+            perror("Error creating thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    histInit(hist);
+    struct CounterSession session;
+    if (counters != NULL) {
+        countersInit(counters);
+        countersStart(&session);
+    }
+
+    for (long long i = 0; i < block_count; ++i) {
+        uint64_t start = timingNow();
+
+        if (i == 0) {
+            static const int advice[] = {0, POSIX_FADV_SEQUENTIAL, POSIX_FADV_RANDOM, POSIX_FADV_NOREUSE,
+                                         POSIX_FADV_WILLNEED};
+            if (kind >= READAHEAD_SEQUENTIAL && kind <= READAHEAD_WILLNEED) {
+                posix_fadvise(fd, 0, kind == READAHEAD_WILLNEED ? totalBytes : 0, advice[kind]);
+            }
+        }
+
+        // Top the window back up once the reader is half way through it
+        long long offset = i * (long long)block_size;
+        if (kind == READAHEAD_EXPLICIT && readaheadEnd - offset < policy->window / 2 && readaheadEnd < totalBytes) {
+            long long length = offset + policy->window - readaheadEnd;
+            readahead(fd, readaheadEnd, length);
+            readaheadEnd += length;
+        }
+
+        bytesRead = read(fd, buffer, block_size);
+
+        uint64_t end = timingNow();
+
+        if (bytesRead == -1) {
+            perror("Error reading from file");
+            exit(EXIT_FAILURE);
+        }
+
+        if (kind == READAHEAD_PREFETCH) {
+            __atomic_store_n(&prefetcher.readerOffset, offset + bytesRead, __ATOMIC_RELEASE);
+        }
+
+        histRecord(hist, timingElapsed(start, end));
+    }
+    if (counters != NULL) {
+        countersStop(&session, counters);
+    }
+
+    if (kind == READAHEAD_PREFETCH) {
+        __atomic_store_n(&prefetcher.stop, 1, __ATOMIC_RELEASE);
+        pthread_join(prefetchId, NULL);
+    }
+
+    poolRelease(buffer);
+    close(fd);
+
+    return histSeconds(hist);
+}
+
+// Mapped submission/completion rings of one io_uring instance
+struct UringRing {
+    int ringFd;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sqPtr;
+    void* cqPtr;
+    size_t sqLen;
+    size_t cqLen;
+    size_t sqesLen;
+};
+
+// Sets up an io_uring with the given number of entries and maps its rings.
+// Returns 0 on success or a negative errno when the kernel refuses io_uring.
+static int uringSetup(struct UringRing* ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->ringFd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->ringFd < 0) {
+        return -errno;
+    }
+
+    ring->sqLen = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqLen = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqLen > ring->sqLen) {
+            ring->sqLen = ring->cqLen;
+        }
+        ring->cqLen = ring->sqLen;
+    }
+
+    ring->sqPtr = mmap(NULL, ring->sqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring->ringFd, IORING_OFF_SQ_RING);
+    if (ring->sqPtr == MAP_FAILED) {
+        int err = -errno;
+        close(ring->ringFd);
+        return err;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqPtr = ring->sqPtr;
+    } else {
+        ring->cqPtr = mmap(NULL, ring->cqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           ring->ringFd, IORING_OFF_CQ_RING);
+        if (ring->cqPtr == MAP_FAILED) {
+            int err = -errno;
+            munmap(ring->sqPtr, ring->sqLen);
+            close(ring->ringFd);
+            return err;
+        }
+    }
+
+    ring->sqesLen = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->ringFd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        int err = -errno;
+        if (ring->cqPtr != ring->sqPtr) {
+            munmap(ring->cqPtr, ring->cqLen);
+        }
+        munmap(ring->sqPtr, ring->sqLen);
+        close(ring->ringFd);
+        return err;
+    }
+
+    char* sq = ring->sqPtr;
+    char* cq = ring->cqPtr;
+    ring->sqHead = (unsigned*)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+    ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+static void uringTeardown(struct UringRing* ring) {
+    munmap(ring->sqes, ring->sqesLen);
+    if (ring->cqPtr != ring->sqPtr) {
+        munmap(ring->cqPtr, ring->cqLen);
+    }
+    munmap(ring->sqPtr, ring->sqLen);
+    close(ring->ringFd);
+}
+
+int uringAvailable(void) {
+    struct UringRing ring;
+    int ret = uringSetup(&ring, 1);
+    if (ret < 0) {
+        fprintf(stderr, "io_uring unavailable (%s), using synchronous reads\n", strerror(-ret));
+        return 0;
+    }
+    uringTeardown(&ring);
+    return 1;
+}
+
+// Reads the file sequentially through io_uring, keeping up to queueDepth
+// block-sized reads in flight. Buffers and the file are registered with the
+// ring when the kernel allows it. counters see the submitting thread only,
+// not kernel workers the reads are handed to. A short completion is
+// resubmitted for the rest of its block, as the vectored reader does. Returns
+// wall-clock seconds, or -1 when the ring or the requested cache state cannot
+// be set up or the file ended before block_count blocks.
+double measureReadTimeUring(const char* filename, int block_size, long long block_count, int queueDepth, int mode,
+                            struct PerfCounters* counters) {
+    if (!prepareCache(filename, mode)) {
+        return -1;
+    }
+
+    int fd = openForMode(filename, mode);
+    if (fd == -1) {
+        return -1;
+    }
+
+    struct UringRing ring;
+    int ret = uringSetup(&ring, queueDepth);
+    if (ret < 0) {
+        fprintf(stderr, "Error setting up io_uring: %s\n", strerror(-ret));
+        close(fd);
+        return -1;
+    }
+
+    char* buffers = poolAcquire((size_t)block_size * queueDepth);
+    struct iovec* iovecs = malloc(sizeof(struct iovec) * queueDepth);
+    int* freeSlots = malloc(sizeof(int) * queueDepth);
+    int* retrySlots = malloc(sizeof(int) * queueDepth);  // Slots whose block was read short
+    off_t* slotOffset = malloc(sizeof(off_t) * queueDepth);
+    int* slotDone = malloc(sizeof(int) * queueDepth);
+    if (iovecs == NULL || freeSlots == NULL || retrySlots == NULL || slotOffset == NULL || slotDone == NULL) {
+        perror("Error allocating buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < queueDepth; ++i) {
+        iovecs[i].iov_base = buffers + (size_t)i * block_size;
+        iovecs[i].iov_len = block_size;
+        freeSlots[i] = i;
+    }
+    int numFree = queueDepth;
+    int numRetry = 0;
+
+    int fixedBuffers = syscall(__NR_io_uring_register, ring.ringFd, IORING_REGISTER_BUFFERS, iovecs, queueDepth) == 0;
+    int fixedFiles = syscall(__NR_io_uring_register, ring.ringFd, IORING_REGISTER_FILES, &fd, 1) == 0;
+
+    long long submitted = 0;
+    long long completed = 0;
+    long long bytes = 0;
+    unsigned toSubmit = 0;  // Queued entries the kernel has not consumed yet, carried over a short submit
+    struct CounterSession session;
+    if (counters != NULL) {
+        countersInit(counters);
+        countersStart(&session);
+    }
+    double start = timingSeconds();
+
+    while (completed < block_count) {
+        // Queue the rest of every short block, then reads for every free buffer
+        unsigned tail = *ring.sqTail;
+        while (numRetry > 0 || (numFree > 0 && submitted < block_count)) {
+            int slot;
+            if (numRetry > 0) {
+                slot = retrySlots[--numRetry];
+            } else {
+                slot = freeSlots[--numFree];
+                slotOffset[slot] = (off_t)submitted * block_size;
+                slotDone[slot] = 0;
+                submitted++;
+            }
+            char* target = buffers + (size_t)slot * block_size + slotDone[slot];
+            int length = block_size - slotDone[slot];
+
+            unsigned index = tail & *ring.sqMask;
+            struct io_uring_sqe* sqe = &ring.sqes[index];
+
+            // READV rather than READ without registered buffers: it is as
+            // old as io_uring itself, READ needs 5.6
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->flags = fixedFiles ? IOSQE_FIXED_FILE : 0;
+            sqe->fd = fixedFiles ? 0 : fd;
+            sqe->off = slotOffset[slot] + slotDone[slot];
+            if (fixedBuffers) {
+                sqe->opcode = IORING_OP_READ_FIXED;
+                sqe->addr = (unsigned long)target;
+                sqe->len = length;
+                sqe->buf_index = slot;
+            } else {
+                // The iovecs are not registered in this case, so they can be moved
+                iovecs[slot].iov_base = target;
+                iovecs[slot].iov_len = length;
+                sqe->opcode = IORING_OP_READV;
+                sqe->addr = (unsigned long)&iovecs[slot];
+                sqe->len = 1;
+            }
+            sqe->user_data = slot;
+
+            ring.sqArray[index] = index;
+            tail++;
+            toSubmit++;
+        }
+        __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+
+        ret = syscall(__NR_io_uring_enter, ring.ringFd, toSubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0 && errno != EINTR) {
+            perror("Error submitting io_uring reads");
+            exit(EXIT_FAILURE);
+        }
+        if (ret > 0) {
+            toSubmit -= ret < (int)toSubmit ? (unsigned)ret : toSubmit;
+        }
+
+        // Reap every completion that is ready
+        unsigned head = *ring.cqHead;
+        while (head != __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cqMask];
+
+            if (cqe->res < 0) {
+                fprintf(stderr, "Error reading from file: %s\n", strerror(-cqe->res));
+                exit(EXIT_FAILURE);
+            }
+
+            int slot = (int)cqe->user_data;
+            bytes += cqe->res;
+            slotDone[slot] += cqe->res;
+            if (cqe->res > 0 && slotDone[slot] < block_size) {
+                retrySlots[numRetry++] = slot;
+            } else {
+                // Full block, or the file ended inside it
+                freeSlots[numFree++] = slot;
+                completed++;
+            }
+            head++;
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    double totalTime = timingSeconds() - start;
+    if (counters != NULL) {
+        countersStop(&session, counters);
+    }
+
+    if (bytes < (long long)block_size * block_count) {
+        fprintf(stderr, "Short read from %s: %lld of %lld bytes, not reporting\n", filename, bytes,
+                (long long)block_size * block_count);
+        totalTime = -1;
+    }
+
+    uringTeardown(&ring);
+    free(slotDone);
+    free(slotOffset);
+    free(retrySlots);
+    free(freeSlots);
+    free(iovecs);
+    poolRelease(buffers);
+    close(fd);
+
+    return totalTime;
+}
+
+// Drops the first bytes of an iovec array and returns the index of the
+// first entry that still has data to read
+static int advanceIovecs(struct iovec* iov, int count, size_t bytes) {
+    int first = 0;
+    while (first < count && bytes >= iov[first].iov_len) {
+        bytes -= iov[first].iov_len;
+        first++;
+    }
+    if (first < count) {
+        iov[first].iov_base = (char*)iov[first].iov_base + bytes;
+        iov[first].iov_len -= bytes;
+    }
+    return first;
+}
+
+// Reads the file iovecs blocks per preadv() call. With nowait, every batch
+// is first tried with preadv2(RWF_NOWAIT), which returns only what the page
+// cache holds; the rest is read with a blocking preadv(). Each sample covers
+// one batch. Returns -1 if the run cannot be reported.
+double measureReadTimeVectored(const char* filename, int block_size, long long block_count, int iovecs,
+                               int nowait, int mode, struct LatencyHistogram* hist, struct VectoredStats* stats,
+                               struct PerfCounters* counters) {
+    if (!prepareCache(filename, mode)) {
+        return -1;
+    }
+
+    int fd = openForMode(filename, mode);
+    if (fd == -1) {
+        return -1;
+    }
+
+    char* buffers = poolAcquire((size_t)block_size * iovecs);
+    struct iovec* iov = malloc(sizeof(struct iovec) * iovecs);
+    if (iov == NULL) {
+        perror("Error allocating buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    histInit(hist);
+    struct CounterSession session;
+    if (counters != NULL) {
+        countersInit(counters);
+        countersStart(&session);
+    }
+    double start = timingSeconds();
+
+    for (long long block = 0; block < block_count; block += iovecs) {
+        int count = block_count - block < iovecs ? (int)(block_count - block) : iovecs;
+        for (int i = 0; i < count; ++i) {
+            iov[i].iov_base = buffers + (size_t)i * block_size;
+            iov[i].iov_len = block_size;
+        }
+        size_t wanted = (size_t)count * block_size;
+        off_t offset = (off_t)block * block_size;
+        size_t got = 0;
+
+        uint64_t opStart = timingNow();
+
+        if (nowait) {
+            ssize_t ret = preadv2(fd, iov, count, offset, RWF_NOWAIT);
+            stats->calls++;
+            if (ret == -1 && errno == EOPNOTSUPP) {
+                fprintf(stderr, "RWF_NOWAIT is not supported for %s, not reporting\n", filename);
+                if (counters != NULL) {
+                    countersStop(&session, counters);
+                }
+                free(iov);
+                poolRelease(buffers);
+                close(fd);
+                return -1;
+            }
+            if (ret == -1 && errno != EAGAIN) {
+                perror("Error reading from file");
+                exit(EXIT_FAILURE);
+            }
+
+            if (ret == -1) {
+                stats->misses++;
+            } else if ((size_t)ret == wanted) {
+                stats->hits++;
+                got = ret;
+            } else {
+                stats->partial++;
+                got = ret;
+            }
+        }
+
+        // Blocking reads finish whatever the page cache could not serve
+        while (got < wanted) {
+            for (int i = 0; i < count; ++i) {
+                iov[i].iov_base = buffers + (size_t)i * block_size;
+                iov[i].iov_len = block_size;
+            }
+            int first = advanceIovecs(iov, count, got);
+
+            ssize_t ret = preadv(fd, iov + first, count - first, offset + got);
+            stats->calls++;
+            if (ret == -1) {
+                perror("Error reading from file");
+                exit(EXIT_FAILURE);
+            }
+            if (ret == 0) {
+                break;
+            }
+            got += ret;
+        }
+
+        histRecord(hist, timingElapsed(opStart, timingNow()));
+    }
+
+    double totalTime = timingSeconds() - start;
+    if (counters != NULL) {
+        countersStop(&session, counters);
+    }
+
+    free(iov);
+    poolRelease(buffers);
+    close(fd);
+
+    return totalTime;
+}
+
+struct ReaderThread {
+    int fd;
+    int block_size;
+    long long block_count;  // Blocks in the whole read
+    long long firstBlock;   // Static range handed to this thread
+    long long numBlocks;
+    int strategy;
+    int chunkBlocks;
+    long long* nextChunk;   // Shared chunk counter for CHUNK_DYNAMIC
+    double totalTime;       // Wall-clock time this thread spent reading
+    int countEvents;
+    struct PerfCounters counters;  // This thread's events, with countEvents
+};
+
+// Reads blocks [firstBlock, firstBlock + numBlocks) with pread()
+static void readBlockRange(struct ReaderThread* data, char* buffer, long long firstBlock, long long numBlocks) {
+    for (long long i = firstBlock; i < firstBlock + numBlocks; ++i) {
+        if (pread(data->fd, buffer, data->block_size, (off_t)i * data->block_size) == -1) {
+            perror("Error reading from file");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void* readerThread(void* arg) {
+    struct ReaderThread* data = (struct ReaderThread*)arg;
+    char* buffer = poolAcquire(data->block_size);
+
+    // perf events opened here count this thread only
+    struct CounterSession session;
+    countersInit(&data->counters);
+    if (data->countEvents) {
+        countersStart(&session);
+    }
+    double start = timingSeconds();
+
+    if (data->strategy == CHUNK_STATIC) {
+        readBlockRange(data, buffer, data->firstBlock, data->numBlocks);
+    } else {
+        for (;;) {
+            long long chunk = __atomic_fetch_add(data->nextChunk, 1, __ATOMIC_RELAXED);
+            long long firstBlock = chunk * data->chunkBlocks;
+            if (firstBlock >= data->block_count) {
+                break;
+            }
+
+            long long numBlocks = data->chunkBlocks;
+            if (firstBlock + numBlocks > data->block_count) {
+                numBlocks = data->block_count - firstBlock;
+            }
+            readBlockRange(data, buffer, firstBlock, numBlocks);
+        }
+    }
+
+    data->totalTime = timingSeconds() - start;
+    if (data->countEvents) {
+        countersStop(&session, &data->counters);
+    }
+
+    poolRelease(buffer);
+
+    return NULL;
+}
+
+// Reads one integer from a CPU topology file, -1 if it is missing
+static int readTopology(int cpu, const char* name) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    int value = -1;
+    if (fscanf(file, "%d", &value) != 1) {
+        value = -1;
+    }
+    fclose(file);
+    return value;
+}
+
+// Placement of one CPU, used to order CPUs for the affinity policies
+struct CpuSlot {
+    int cpu;
+    int package;
+    int core;     // Index of the core within its package
+    int sibling;  // Index of the CPU among the SMT siblings of its core
+};
+
+static int compareCompact(const void* a, const void* b) {
+    const struct CpuSlot* x = a;
+    const struct CpuSlot* y = b;
+    if (x->package != y->package) {
+        return x->package - y->package;
+    }
+    if (x->core != y->core) {
+        return x->core - y->core;
+    }
+    return x->sibling - y->sibling;
+}
+
+static int compareScatter(const void* a, const void* b) {
+    const struct CpuSlot* x = a;
+    const struct CpuSlot* y = b;
+    if (x->sibling != y->sibling) {
+        return x->sibling - y->sibling;
+    }
+    if (x->core != y->core) {
+        return x->core - y->core;
+    }
+    return x->package - y->package;
+}
+
+// Fills cpus with the CPUs this process may run on, in the order threads are
+// placed on them: compact fills every SMT sibling of a core before the next
+// core, scatter spreads over packages and cores before using siblings.
+// Returns the number of CPUs.
+int affinityOrder(int policy, int* cpus) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        perror("Error getting CPU affinity");
+        exit(EXIT_FAILURE);
+    }
+
+    struct CpuSlot slots[CPU_SETSIZE];
+    int numCpus = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        slots[numCpus].cpu = cpu;
+        slots[numCpus].package = readTopology(cpu, "physical_package_id");
+        slots[numCpus].core = readTopology(cpu, "core_id");
+        slots[numCpus].sibling = 0;
+        numCpus++;
+    }
+
+    // Number the siblings of each core in CPU order
+    for (int i = 0; i < numCpus; ++i) {
+        for (int j = 0; j < i; ++j) {
+            if (slots[j].package == slots[i].package && slots[j].core == slots[i].core) {
+                slots[i].sibling++;
+            }
+        }
+    }
+
+    qsort(slots, numCpus, sizeof(slots[0]), policy == AFFINITY_SCATTER ? compareScatter : compareCompact);
+    for (int i = 0; i < numCpus; ++i) {
+        cpus[i] = slots[i].cpu;
+    }
+    return numCpus;
+}
+
+// Reads the file with numThreads threads over disjoint ranges, split up front
+// or handed out in chunks depending on strategy. counters, if not NULL, get
+// the sum over all threads. Thread i is pinned to cpus[i % numCpus]; cpus
+// NULL leaves placement to the scheduler. Returns the wall-clock time of the
+// whole read, or -1 if the run cannot be reported.
+double measureReadTimeParallel(const char* filename, int block_size, long long block_count, int numThreads,
+                               int strategy, int chunkBlocks, int mode, struct ThreadSkew* skew,
+                               struct PerfCounters* counters, const int* cpus, int numCpus) {
+    if (!prepareCache(filename, mode)) {
+        return -1;
+    }
+
+    int fd = openForMode(filename, mode);
+    if (fd == -1) {
+        return -1;
+    }
+
+    pthread_t* threads = malloc(sizeof(pthread_t) * numThreads);
+    struct ReaderThread* data = malloc(sizeof(struct ReaderThread) * numThreads);
+    if (threads == NULL || data == NULL) {
+        perror("Error allocating thread data");
+        exit(EXIT_FAILURE);
+    }
+
+    long long nextChunk = 0;
+    double start = timingSeconds();
+
+    for (int i = 0; i < numThreads; ++i) {
+        data[i].fd = fd;
+        data[i].block_size = block_size;
+        data[i].block_count = block_count;
+        data[i].firstBlock = block_count * i / numThreads;
+        data[i].numBlocks = block_count * (i + 1) / numThreads - data[i].firstBlock;
+        data[i].strategy = strategy;
+        data[i].chunkBlocks = chunkBlocks;
+        data[i].nextChunk = &nextChunk;
+        data[i].totalTime = 0.0;
+        data[i].countEvents = counters != NULL;
+
+        // Pinned before it starts so the thread never runs anywhere else
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (cpus != NULL) {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(cpus[i % numCpus], &cpuSet);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpuSet), &cpuSet);
+        }
+
+        if (pthread_create(&threads[i], &attr, readerThread, &data[i]) != 0) {
+            perror("Error creating thread");
+            exit(EXIT_FAILURE);
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    for (int i = 0; i < numThreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    double totalTime = timingSeconds() - start;
+
+    if (counters != NULL) {
+        countersInit(counters);
+        for (int i = 0; i < numThreads; ++i) {
+            countersAdd(counters, &data[i].counters);
+        }
+    }
+
+    skew->fastest = data[0].totalTime;
+    skew->slowest = data[0].totalTime;
+    for (int i = 1; i < numThreads; ++i) {
+        if (data[i].totalTime < skew->fastest) {
+            skew->fastest = data[i].totalTime;
+        }
+        if (data[i].totalTime > skew->slowest) {
+            skew->slowest = data[i].totalTime;
+        }
+    }
+
+    free(data);
+    free(threads);
+    close(fd);
+
+    return totalTime;
+}
+
+static const char* patternKindNames[] = {"sequential", "uniform", "zipf", "hotset"};
+
+// Parses sequential, uniform, zipf[:skew] or hotset[:fraction[:probability]].
+// Returns 0 if the name is not a valid pattern.
+int parseAccessPattern(const char* name, struct AccessPattern* pattern) {
+    pattern->skew = 0.99;
+    pattern->hotFraction = 0.1;
+    pattern->hotProbability = 0.9;
+
+    for (int kind = PATTERN_SEQUENTIAL; kind <= PATTERN_HOTSET; ++kind) {
+        size_t length = strlen(patternKindNames[kind]);
+        if (strncmp(name, patternKindNames[kind], length) != 0 || (name[length] != '\0' && name[length] != ':')) {
+            continue;
+        }
+        pattern->kind = kind;
+
+        const char* p = name + length;
+        if (*p == '\0') {
+            return 1;
+        }
+
+        char* end;
+        if (kind == PATTERN_ZIPF) {
+            pattern->skew = strtod(p + 1, &end);
+            return *end == '\0' && pattern->skew > 0;
+        }
+        if (kind == PATTERN_HOTSET) {
+            pattern->hotFraction = strtod(p + 1, &end);
+            if (*end == ':') {
+                pattern->hotProbability = strtod(end + 1, &end);
+            }
+            return *end == '\0' && pattern->hotFraction > 0 && pattern->hotFraction < 1 &&
+                   pattern->hotProbability >= 0 && pattern->hotProbability <= 1;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+void accessPatternName(const struct AccessPattern* pattern, char* name, size_t size) {
+    if (pattern->kind == PATTERN_ZIPF) {
+        snprintf(name, size, "zipf:%g", pattern->skew);
+    } else if (pattern->kind == PATTERN_HOTSET) {
+        snprintf(name, size, "hotset:%g:%g", pattern->hotFraction, pattern->hotProbability);
+    } else {
+        snprintf(name, size, "%s", patternKindNames[pattern->kind]);
+    }
+}
+
+// Draws block numbers for one access pattern in constant memory. Ranks are
+// mapped to blocks through a keyed permutation so skewed patterns do not
+// simply favour the start of the file.
+struct BlockSampler {
+    const struct AccessPattern* pattern;
+    long long numBlocks;
+    long long hotBlocks;
+    int halfBits;        // Half the width of the permutation domain
+    uint64_t keys[4];    // Round keys of the permutation
+    double hX1;          // Zipf rejection-inversion constants, see samplerZipf()
+    double hN;
+    double squeeze;
+};
+
+static uint64_t nextRandom(uint64_t* state) {
+    // xorshift64*
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static double nextUniform(uint64_t* state) {
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Round function of the permutation (the splitmix64 finalizer)
+static uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Rank to block number: a 4-round Feistel network over the smallest even
+// bit width covering the file, walked until it lands inside the file. That
+// is a bijection on [0, numBlocks) and needs no table.
+static long long samplerPermute(const struct BlockSampler* sampler, long long rank) {
+    uint64_t mask = (1ULL << sampler->halfBits) - 1;
+    uint64_t x = rank;
+    do {
+        uint64_t left = x >> sampler->halfBits;
+        uint64_t right = x & mask;
+        for (int round = 0; round < 4; ++round) {
+            uint64_t next = left ^ (mix64(right + sampler->keys[round]) & mask);
+            left = right;
+            right = next;
+        }
+        x = (left << sampler->halfBits) | right;
+    } while (x >= (uint64_t)sampler->numBlocks);
+    return x;
+}
+
+// log1p(x) / x and expm1(x) / x, with their series near 0
+static double zipfHelper1(double x) {
+    return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+}
+
+static double zipfHelper2(double x) {
+    return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+}
+
+// h(x) = x^-skew, its integral H and the inverse of H
+static double zipfH(double x, double skew) {
+    return exp(-skew * log(x));
+}
+
+static double zipfHIntegral(double x, double skew) {
+    double logX = log(x);
+    return zipfHelper2((1 - skew) * logX) * logX;
+}
+
+static double zipfHIntegralInverse(double x, double skew) {
+    double t = x * (1 - skew);
+    if (t < -1) {
+        t = -1;
+    }
+    return exp(zipfHelper1(t) * x);
+}
+
+static void samplerInit(struct BlockSampler* sampler, const struct AccessPattern* pattern, long long numBlocks) {
+    memset(sampler, 0, sizeof(*sampler));
+    sampler->pattern = pattern;
+    sampler->numBlocks = numBlocks;
+
+    sampler->halfBits = 1;
+    while (sampler->halfBits < 32 && (1ULL << (2 * sampler->halfBits)) < (uint64_t)numBlocks) {
+        sampler->halfBits++;
+    }
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (int round = 0; round < 4; ++round) {
+        sampler->keys[round] = nextRandom(&state);
+    }
+
+    if (pattern->kind == PATTERN_HOTSET) {
+        sampler->hotBlocks = (long long)(pattern->hotFraction * numBlocks);
+        if (sampler->hotBlocks < 1) {
+            sampler->hotBlocks = 1;
+        }
+    } else if (pattern->kind == PATTERN_ZIPF) {
+        double skew = pattern->skew;
+        sampler->hX1 = zipfHIntegral(1.5, skew) - 1.0;
+        sampler->hN = zipfHIntegral(numBlocks + 0.5, skew);
+        sampler->squeeze = 2 - zipfHIntegralInverse(zipfHIntegral(2.5, skew) - zipfH(2, skew), skew);
+    }
+}
+
+// Zipf rank in [1, numBlocks] by rejection-inversion (Hormann and Derflinger,
+// 1996): invert the integral of x^-skew and accept with a cheap squeeze test,
+// about one uniform per draw and no table over the ranks.
+static long long samplerZipf(const struct BlockSampler* sampler, uint64_t* state) {
+    double skew = sampler->pattern->skew;
+    for (;;) {
+        double u = sampler->hN + nextUniform(state) * (sampler->hX1 - sampler->hN);
+        double x = zipfHIntegralInverse(u, skew);
+        long long k = (long long)(x + 0.5);
+        if (k < 1) {
+            k = 1;
+        } else if (k > sampler->numBlocks) {
+            k = sampler->numBlocks;
+        }
+        if (k - x <= sampler->squeeze || u >= zipfHIntegral(k + 0.5, skew) - zipfH(k, skew)) {
+            return k;
+        }
+    }
+}
+
+// Next block to read. sequence is the read's position in the thread's
+// stream, used by the sequential pattern.
+static long long samplerNext(const struct BlockSampler* sampler, uint64_t* state, long long sequence) {
+    long long n = sampler->numBlocks;
+
+    switch (sampler->pattern->kind) {
+        case PATTERN_SEQUENTIAL:
+            return sequence % n;
+        case PATTERN_UNIFORM:
+            return nextRandom(state) % n;
+        case PATTERN_HOTSET:
+            if (nextUniform(state) < sampler->pattern->hotProbability || sampler->hotBlocks == n) {
+                return samplerPermute(sampler, nextRandom(state) % sampler->hotBlocks);
+            }
+            return samplerPermute(sampler, sampler->hotBlocks + nextRandom(state) % (n - sampler->hotBlocks));
+    }
+
+    return samplerPermute(sampler, samplerZipf(sampler, state) - 1);
+}
+
+struct RandomReader {
+    int fd;
+    int block_size;
+    long long numReads;
+    long long firstSequence;  // Where this thread's sequential stream starts
+    uint64_t seed;
+    const struct BlockSampler* sampler;
+    struct LatencyHistogram hist;
+    int countEvents;
+    struct PerfCounters counters;
+};
+
+static void* randomReaderThread(void* arg) {
+    struct RandomReader* data = (struct RandomReader*)arg;
+    char* buffer = poolAcquire(data->block_size);
+    uint64_t state = data->seed;
+
+    histInit(&data->hist);
+    struct CounterSession session;
+    countersInit(&data->counters);
+    if (data->countEvents) {
+        countersStart(&session);
+    }
+
+    for (long long i = 0; i < data->numReads; ++i) {
+        long long block = samplerNext(data->sampler, &state, data->firstSequence + i);
+
+        uint64_t start = timingNow();
+        ssize_t bytesRead = pread(data->fd, buffer, data->block_size, (off_t)block * data->block_size);
+        uint64_t end = timingNow();
+
+        if (bytesRead == -1) {
+            perror("Error reading from file");
+            exit(EXIT_FAILURE);
+        }
+        histRecord(&data->hist, timingElapsed(start, end));
+    }
+
+    if (data->countEvents) {
+        countersStop(&session, &data->counters);
+    }
+    poolRelease(buffer);
+
+    return NULL;
+}
+
+// Issues numReads block-aligned pread()s spread over numThreads threads, at
+// blocks drawn from pattern. hist gets every read's latency and counters, if
+// not NULL, the events of all threads. Returns the wall-clock time, or -1 if
+// the run cannot be reported.
+double measureRandomReadTime(const char* filename, int block_size, long long block_count, long long numReads,
+                             int numThreads, const struct AccessPattern* pattern, int mode,
+                             struct LatencyHistogram* hist, struct PerfCounters* counters) {
+    if (block_count == 0) {
+        return -1;
+    }
+
+    struct BlockSampler sampler;
+    samplerInit(&sampler, pattern, block_count);
+
+    if (!prepareCache(filename, mode)) {
+        return -1;
+    }
+
+    int fd = openForMode(filename, mode);
+    if (fd == -1) {
+        return -1;
+    }
+
+    pthread_t* threads = malloc(sizeof(pthread_t) * numThreads);
+    struct RandomReader* data = malloc(sizeof(struct RandomReader) * numThreads);
+    if (threads == NULL || data == NULL) {
+        perror("Error allocating thread data");
+        exit(EXIT_FAILURE);
+    }
+
+    double start = timingSeconds();
+
+    for (int i = 0; i < numThreads; ++i) {
+        data[i].fd = fd;
+        data[i].block_size = block_size;
+        data[i].numReads = numReads * (i + 1) / numThreads - numReads * i / numThreads;
+        data[i].firstSequence = block_count * i / numThreads;
+        data[i].seed = 0x853C49E6748FEA9BULL * (i + 1);
+        data[i].sampler = &sampler;
+        data[i].countEvents = counters != NULL;
+
+        if (pthread_create(&threads[i], NULL, randomReaderThread, &data[i]) != 0) {
+            perror("Error creating thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    histInit(hist);
+    if (counters != NULL) {
+        countersInit(counters);
+    }
+    for (int i = 0; i < numThreads; ++i) {
+        pthread_join(threads[i], NULL);
+        histMerge(hist, &data[i].hist);
+        if (counters != NULL) {
+            countersAdd(counters, &data[i].counters);
+        }
+    }
+
+    double totalTime = timingSeconds() - start;
+
+    free(data);
+    free(threads);
+    close(fd);
+
+    return totalTime;
+}
+
+static const char* warmKindNames[] = {"prefix", "random", "striped"};
+
+// Parses prefix, random or striped[:KiB]. Returns 0 if the name is not a
+// valid layout.
+int parseWarmLayout(const char* name, struct WarmLayout* layout) {
+    layout->stripe = WARM_DEFAULT_STRIPE;
+
+    for (int kind = WARM_PREFIX; kind <= WARM_STRIPED; ++kind) {
+        size_t length = strlen(warmKindNames[kind]);
+        if (strncmp(name, warmKindNames[kind], length) != 0 || (name[length] != '\0' && name[length] != ':')) {
+            continue;
+        }
+        layout->kind = kind;
+
+        if (name[length] == '\0') {
+            return 1;
+        }
+        if (kind != WARM_STRIPED) {
+            return 0;
+        }
+
+        char* end;
+        long long kib = strtoll(name + length + 1, &end, 10);
+        layout->stripe = kib * KILOBYTE;
+        return *end == '\0' && kib > 0;
+    }
+    return 0;
+}
+
+void warmLayoutName(const struct WarmLayout* layout, char* name, size_t size) {
+    if (layout->kind == WARM_STRIPED) {
+        snprintf(name, size, "striped:%lld", layout->stripe / KILOBYTE);
+    } else {
+        snprintf(name, size, "%s", warmKindNames[layout->kind]);
+    }
+}
+
+// Reads count pages starting at page first into the page cache
+static void warmPages(int fd, char* buffer, long long first, long long count, long pageSize) {
+    off_t offset = first * pageSize;
+    off_t end = (first + count) * pageSize;
+
+    while (offset < end) {
+        size_t length = end - offset < WARM_CHUNK ? end - offset : WARM_CHUNK;
+        ssize_t bytesRead = pread(fd, buffer, length, offset);
+        if (bytesRead == -1) {
+            perror("Error reading from file");
+            exit(EXIT_FAILURE);
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        offset += bytesRead;
+    }
+}
+
+// Evicts the file, then reads fraction of its pages back into the page cache
+// in the given layout:
+//   prefix   the first pages of the file
+//   random   pages picked uniformly, exactly fraction of them
+//   striped  the first fraction of every stripe
+// Returns the resident fraction mincore() reports afterwards, or -1 if the
+// file could not be evicted first.
+double warmFileFraction(const char* filename, double fraction, const struct WarmLayout* layout) {
+    if (clearDiskCache(filename) > MAX_COLD_RESIDENCY) {
+        fprintf(stderr, "Cache eviction failed for %s, not reporting\n", filename);
+        return -1;
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("Error opening file for reading");
+        exit(EXIT_FAILURE);
+    }
+
+    // Without readahead only the pages asked for end up in the cache
+    int ret = posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+    if (ret != 0) {
+        fprintf(stderr, "Error advising kernel: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    long long numPages = (fileSize(filename) + pageSize - 1) / pageSize;
+    long long wanted = (long long)(fraction * numPages + 0.5);
+    char* buffer = poolAcquire(WARM_CHUNK);
+
+    if (layout->kind == WARM_PREFIX) {
+        warmPages(fd, buffer, 0, wanted, pageSize);
+    } else if (layout->kind == WARM_RANDOM) {
+        // Selection sampling: every page is taken with probability
+        // still wanted / still left, which picks exactly wanted pages in order
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        for (long long page = 0; page < numPages && wanted > 0; ++page) {
+            if (nextUniform(&state) * (numPages - page) < wanted) {
+                warmPages(fd, buffer, page, 1, pageSize);
+                --wanted;
+            }
+        }
+    } else {
+        long long stripePages = layout->stripe / pageSize > 0 ? layout->stripe / pageSize : 1;
+        for (long long first = 0; first < numPages; first += stripePages) {
+            long long length = numPages - first < stripePages ? numPages - first : stripePages;
+            warmPages(fd, buffer, first, (long long)(fraction * length + 0.5), pageSize);
+        }
+    }
+
+    double residency = fileResidency(fd);
+
+    poolRelease(buffer);
+    close(fd);
+
+    return residency;
+}
+
+// Creates every directory of a tree of TREE_FANOUT^depth leaf directories
+static void makeTreeDirectories(const char* root, int depth) {
+    if (mkdir(root, S_IRWXU) == -1 && errno != EEXIST) {
+        perror("Error creating directory");
+        exit(EXIT_FAILURE);
+    }
+
+    long long numDirs = 1;
+    for (int level = 0; level < depth; ++level) {
+        numDirs *= TREE_FANOUT;
+        for (long long dir = 0; dir < numDirs; ++dir) {
+            char path[4096];
+            int length = snprintf(path, sizeof(path), "%s", root);
+            long long scale = numDirs;
+            for (int l = 0; l <= level; ++l) {
+                scale /= TREE_FANOUT;
+                length += snprintf(path + length, sizeof(path) - length, "/%02llx", dir / scale % TREE_FANOUT);
+            }
+            if (mkdir(path, S_IRWXU) == -1 && errno != EEXIST) {
+                perror("Error creating directory");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+}
+
+// Lays out numFiles files round robin over the leaf directories of a tree
+// under root, with sizes drawn log-uniformly from [minSize, maxSize] by a
+// fixed seed. Files that are missing or have the wrong size are (re)written,
+// so a tree built by an earlier run is reused as is.
+void buildFileTree(const char* root, int numFiles, int depth, int minSize, int maxSize, struct FileTree* tree) {
+    makeTreeDirectories(root, depth);
+
+    long long numDirs = 1;
+    for (int level = 0; level < depth; ++level) {
+        numDirs *= TREE_FANOUT;
+    }
+
+    tree->numFiles = numFiles;
+    tree->maxSize = maxSize;
+    tree->paths = malloc(sizeof(char*) * numFiles);
+    tree->sizes = malloc(sizeof(int) * numFiles);
+    char* contents = poolAcquire(maxSize);
+    if (tree->paths == NULL || tree->sizes == NULL) {
+        perror("Error allocating file tree");
+        exit(EXIT_FAILURE);
+    }
+    memset(contents, 0x5a, maxSize);
+
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    int created = 0;
+
+    for (int i = 0; i < numFiles; ++i) {
+        char path[4096];
+        int length = snprintf(path, sizeof(path), "%s", root);
+        long long dir = i % numDirs;
+        long long scale = numDirs;
+        for (int level = 0; level < depth; ++level) {
+            scale /= TREE_FANOUT;
+            length += snprintf(path + length, sizeof(path) - length, "/%02llx", dir / scale % TREE_FANOUT);
+        }
+        snprintf(path + length, sizeof(path) - length, "/f%07d", i);
+
+        double u = nextUniform(&state);
+        int size = (int)(minSize * pow((double)maxSize / minSize, u));
+
+        tree->paths[i] = strdup(path);
+        tree->sizes[i] = size;
+        if (tree->paths[i] == NULL) {
+            perror("Error allocating file tree");
+            exit(EXIT_FAILURE);
+        }
+
+        struct stat fileStat;
+        if (stat(path, &fileStat) == 0 && fileStat.st_size == size) {
+            continue;
+        }
+
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        if (fd == -1) {
+            perror("Error creating file");
+            exit(EXIT_FAILURE);
+        }
+        if (write(fd, contents, size) != size) {
+            perror("Error writing file");
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+        created++;
+    }
+
+    if (created > 0) {
+        fprintf(stderr, "Created %d of %d files under %s\n", created, numFiles, root);
+    }
+
+    poolRelease(contents);
+}
+
+void freeFileTree(struct FileTree* tree) {
+    for (int i = 0; i < tree->numFiles; ++i) {
+        free(tree->paths[i]);
+    }
+    free(tree->paths);
+    free(tree->sizes);
+}
+
+// Drops every file of the tree from the page cache. Dentries and inodes stay
+// cached, evicting those needs root.
+static void evictFileTree(const struct FileTree* tree) {
+    for (int i = 0; i < tree->numFiles; ++i) {
+        clearDiskCache(tree->paths[i]);
+    }
+}
+
+struct SmallFileReader {
+    const struct FileTree* tree;
+    int* nextFile;  // Shared work counter
+    long long bytes;
+    struct LatencyHistogram hist;
+};
+
+static void* smallFileThread(void* arg) {
+    struct SmallFileReader* data = (struct SmallFileReader*)arg;
+    char* buffer = poolAcquire(data->tree->maxSize);
+
+    histInit(&data->hist);
+    data->bytes = 0;
+
+    for (;;) {
+        int i = __atomic_fetch_add(data->nextFile, 1, __ATOMIC_RELAXED);
+        if (i >= data->tree->numFiles) {
+            break;
+        }
+
+        uint64_t start = timingNow();
+
+        int fd = open(data->tree->paths[i], O_RDONLY);
+        if (fd == -1) {
+            perror("Error opening file for reading");
+            exit(EXIT_FAILURE);
+        }
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) == -1) {
+            perror("Error getting file information");
+            exit(EXIT_FAILURE);
+        }
+        off_t got = 0;
+        while (got < fileStat.st_size && got < data->tree->maxSize) {
+            ssize_t bytesRead = read(fd, buffer + got, data->tree->maxSize - got);
+            if (bytesRead == -1) {
+                perror("Error reading from file");
+                exit(EXIT_FAILURE);
+            }
+            if (bytesRead == 0) {
+                break;
+            }
+            got += bytesRead;
+        }
+        close(fd);
+
+        histRecord(&data->hist, timingElapsed(start, timingNow()));
+        data->bytes += got;
+    }
+
+    poolRelease(buffer);
+
+    return NULL;
+}
+
+// Runs open+fstat+read+close over every file of the tree with numThreads
+// threads taking files from a shared counter. hist gets the time of each
+// file. Returns wall-clock seconds; *bytes is the data read.
+double measureSmallFiles(const struct FileTree* tree, int numThreads, int mode, struct LatencyHistogram* hist,
+                         long long* bytes) {
+    if (mode == READ_COLD) {
+        evictFileTree(tree);
+    }
+
+    pthread_t* threads = malloc(sizeof(pthread_t) * numThreads);
+    struct SmallFileReader* data = malloc(sizeof(struct SmallFileReader) * numThreads);
+    if (threads == NULL || data == NULL) {
+        perror("Error allocating thread data");
+        exit(EXIT_FAILURE);
+    }
+
+    int nextFile = 0;
+    double start = timingSeconds();
+
+    for (int i = 0; i < numThreads; ++i) {
+        data[i].tree = tree;
+        data[i].nextFile = &nextFile;
+        if (pthread_create(&threads[i], NULL, smallFileThread, &data[i]) != 0) {
+            perror("Error creating thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    histInit(hist);
+    *bytes = 0;
+    for (int i = 0; i < numThreads; ++i) {
+        pthread_join(threads[i], NULL);
+        histMerge(hist, &data[i].hist);
+        *bytes += data[i].bytes;
+    }
+
+    double totalTime = timingSeconds() - start;
+
+    free(data);
+    free(threads);
+
+    return totalTime;
+}
+
+static struct io_uring_sqe* uringNextSqe(struct UringRing* ring, unsigned* tail) {
+    unsigned index = *tail & *ring->sqMask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqArray[index] = index;
+    (*tail)++;
+    return sqe;
+}
+
+// Submits everything queued up to tail and waits for count completions,
+// storing each result by its user_data. Returns the first error, or 0.
+static int uringRunBatch(struct UringRing* ring, unsigned tail, unsigned count, int* results) {
+    __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+
+    unsigned toSubmit = count;
+    unsigned reaped = 0;
+    int error = 0;
+    while (reaped < count) {
+        int ret = syscall(__NR_io_uring_enter, ring->ringFd, toSubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0 && errno != EINTR) {
+            perror("Error submitting io_uring batch");
+            exit(EXIT_FAILURE);
+        }
+        if (ret > 0) {
+            toSubmit -= ret < (int)toSubmit ? (unsigned)ret : toSubmit;
+        }
+
+        unsigned head = *ring->cqHead;
+        while (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+            results[cqe->user_data] = cqe->res;
+            if (cqe->res < 0 && error == 0) {
+                error = cqe->res;
+            }
+            head++;
+            reaped++;
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    return error;
+}
+
+// Same work as measureSmallFiles() on one thread, batchSize files at a time
+// through io_uring: one submission opens and statx()es the batch, one reads
+// it and one closes it. hist gets the time of each batch. Returns -1 when
+// the kernel lacks the io_uring operations.
+double measureSmallFilesUring(const struct FileTree* tree, int batchSize, int mode, struct LatencyHistogram* hist,
+                              long long* bytes) {
+    struct UringRing ring;
+    int ret = uringSetup(&ring, 2 * batchSize);
+    if (ret < 0) {
+        fprintf(stderr, "Error setting up io_uring: %s\n", strerror(-ret));
+        return -1;
+    }
+
+    if (mode == READ_COLD) {
+        evictFileTree(tree);
+    }
+
+    char* buffers = poolAcquire((size_t)tree->maxSize * batchSize);
+    struct statx* stats = malloc(sizeof(struct statx) * batchSize);
+    int* results = malloc(sizeof(int) * 2 * batchSize);
+    if (stats == NULL || results == NULL) {
+        perror("Error allocating buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    histInit(hist);
+    *bytes = 0;
+    double start = timingSeconds();
+
+    for (int first = 0; first < tree->numFiles; first += batchSize) {
+        int count = tree->numFiles - first < batchSize ? tree->numFiles - first : batchSize;
+        uint64_t batchStart = timingNow();
+
+        // Results 0..count-1 are file descriptors, count..2*count-1 statx results
+        unsigned tail = *ring.sqTail;
+        for (int i = 0; i < count; ++i) {
+            struct io_uring_sqe* sqe = uringNextSqe(&ring, &tail);
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long)tree->paths[first + i];
+            sqe->open_flags = O_RDONLY;
+            sqe->user_data = i;
+
+            sqe = uringNextSqe(&ring, &tail);
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long)tree->paths[first + i];
+            sqe->len = STATX_SIZE;
+            sqe->off = (unsigned long)&stats[i];
+            sqe->user_data = count + i;
+        }
+        ret = uringRunBatch(&ring, tail, 2 * count, results);
+        if (ret < 0) {
+            // The opens may have succeeded where their statx failed
+            for (int i = 0; i < count; ++i) {
+                if (results[i] >= 0) {
+                    close(results[i]);
+                }
+            }
+        }
+        if (ret == -EINVAL || ret == -EOPNOTSUPP) {
+            fprintf(stderr, "io_uring openat/statx not supported by this kernel\n");
+            free(results);
+            free(stats);
+            poolRelease(buffers);
+            uringTeardown(&ring);
+            return -1;
+        }
+        if (ret < 0) {
+            fprintf(stderr, "Error opening file through io_uring: %s\n", strerror(-ret));
+            exit(EXIT_FAILURE);
+        }
+
+        tail = *ring.sqTail;
+        for (int i = 0; i < count; ++i) {
+            long long size = stats[i].stx_size < (unsigned long long)tree->maxSize ? (long long)stats[i].stx_size
+                                                                                    : tree->maxSize;
+            struct io_uring_sqe* sqe = uringNextSqe(&ring, &tail);
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = results[i];
+            sqe->addr = (unsigned long)(buffers + (size_t)i * tree->maxSize);
+            sqe->len = size;
+            sqe->off = 0;
+            sqe->user_data = count + i;
+        }
+        ret = uringRunBatch(&ring, tail, count, results);
+        if (ret < 0) {
+            fprintf(stderr, "Error reading file through io_uring: %s\n", strerror(-ret));
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < count; ++i) {
+            *bytes += results[count + i];
+        }
+
+        tail = *ring.sqTail;
+        for (int i = 0; i < count; ++i) {
+            struct io_uring_sqe* sqe = uringNextSqe(&ring, &tail);
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = results[i];
+            sqe->user_data = count + i;
+        }
+        uringRunBatch(&ring, tail, count, results);
+
+        histRecord(hist, timingElapsed(batchStart, timingNow()));
+    }
+
+    double totalTime = timingSeconds() - start;
+
+    free(results);
+    free(stats);
+    poolRelease(buffers);
+    uringTeardown(&ring);
+
+    return totalTime;
+}
+
+static void syncFile(int fd, int kind) {
+    int ret = kind == SYNC_FSYNC ? fsync(fd) : fdatasync(fd);
+    if (ret == -1) {
+        perror("Error syncing file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Starts writeback of the window just written and waits for the one before
+// it, then drops that one from the page cache. Dirty data stays bounded to
+// about two windows and the device always has the next window queued.
+static void pipelineWriteback(int fd, off_t windowStart, off_t windowLength) {
+    if (sync_file_range(fd, windowStart, windowLength, SYNC_FILE_RANGE_WRITE) == -1) {
+        perror("Error starting writeback");
+        exit(EXIT_FAILURE);
+    }
+    if (windowStart == 0) {
+        return;
+    }
+
+    off_t previous = windowStart - windowLength;
+    if (sync_file_range(fd, previous, windowLength,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) == -1) {
+        perror("Error waiting for writeback");
+        exit(EXIT_FAILURE);
+    }
+    posix_fadvise(fd, previous, windowLength, POSIX_FADV_DONTNEED);
+}
+
+// Writes the file offset of every page of the block into its first bytes
+static void stampBlock(char* buffer, int block_size, long long offset) {
+    for (int page = 0; page + (int)sizeof(offset) <= block_size; page += BUFFER_ALIGN) {
+        long long tag = offset + page;
+        memcpy(buffer + page, &tag, sizeof(tag));
+    }
+}
+
+// Writes block_count blocks to a freshly truncated file and applies the
+// durability policy. Each sample covers one write() plus any flush it
+// triggered, so flush stalls show up in the tail. Returns wall-clock seconds
+// including the final flush, or -1 if the mode or preallocation is not
+// supported here. counters, if not NULL, cover the writes and flushes.
+double measureWriteTime(const char* filename, int block_size, long long block_count, int mode,
+                        const struct SyncPolicy* policy, int preallocate, struct LatencyHistogram* hist,
+                        struct PerfCounters* counters) {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (mode == WRITE_DIRECT) {
+        flags |= O_DIRECT;
+    } else if (mode == WRITE_DSYNC) {
+        flags |= O_DSYNC;
+    }
+
+    int fd = open(filename, flags, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        perror("Error opening file for writing");
+        return -1;
+    }
+    if (mode == WRITE_DIRECT && !directBuffersAligned(filename)) {
+        close(fd);
+        return -1;
+    }
+
+    long long totalBytes = (long long)block_size * block_count;
+    if (preallocate) {
+        int ret = fallocate(fd, 0, 0, totalBytes);
+        if (ret == -1) {
+            perror("Error preallocating file");
+            close(fd);
+            return -1;
+        }
+        // Make the allocation itself durable so it is not charged to the run
+        syncFile(fd, SYNC_FSYNC);
+    }
+
+    // Random contents defeat compression; stampBlock() makes every page
+    // unique so deduplication cannot skip the writes either
+    char* buffer = poolAcquire(block_size);
+    for (int i = 0; i < block_size; ++i) {
+        buffer[i] = rand() % 256;
+    }
+
+    histInit(hist);
+    struct CounterSession session;
+    if (counters != NULL) {
+        countersInit(counters);
+        countersStart(&session);
+    }
+    double start = timingSeconds();
+
+    for (long long i = 0; i < block_count; ++i) {
+        stampBlock(buffer, block_size, (long long)i * block_size);
+
+        uint64_t opStart = timingNow();
+
+        if (write(fd, buffer, block_size) != block_size) {
+            perror("Error writing to file");
+            exit(EXIT_FAILURE);
+        }
+
+        if (policy->everyBlocks > 0 && (i + 1) % policy->everyBlocks == 0) {
+            if (policy->kind == SYNC_PIPELINE) {
+                off_t windowLength = (off_t)policy->everyBlocks * block_size;
+                pipelineWriteback(fd, (i + 1) * (off_t)block_size - windowLength, windowLength);
+            } else {
+                syncFile(fd, policy->kind);
+            }
+        }
+
+        histRecord(hist, timingElapsed(opStart, timingNow()));
+    }
+
+    // Policies that flush at the end, and the pipeline tail, finish durable
+    if (policy->kind == SYNC_PIPELINE) {
+        syncFile(fd, SYNC_FDATASYNC);
+    } else if (policy->kind != SYNC_NONE) {
+        syncFile(fd, policy->kind);
+    }
+
+    double totalTime = timingSeconds() - start;
+    if (counters != NULL) {
+        countersStop(&session, counters);
+    }
+
+    poolRelease(buffer);
+    close(fd);
+
+    return totalTime;
+}
+
+// Group-commit log shared by the producers and the commit thread. Records are
+// appended to the pending buffer; the commit thread swaps it with the spare,
+// writes it out and fdatasync()s, then wakes everyone whose record is durable.
+struct GroupLog {
+    int fd;
+    int recordSize;
+    int windowUs;    // How long a batch stays open after its first record
+    int maxBatch;    // Records that close a batch early, 0 for no limit
+    pthread_mutex_t lock;
+    pthread_cond_t recordAdded;
+    pthread_cond_t committed;
+    char* pending;
+    char* spare;
+    int numPending;
+    uint64_t firstPendingTime;  // timingNow() of the oldest pending record
+    long long appended;         // Sequence number of the last appended record
+    long long durable;          // Sequence number of the last durable record
+    off_t offset;
+    int done;
+    long long batches;
+};
+
+struct Producer {
+    struct GroupLog* log;
+    long long numRecords;
+    struct LatencyHistogram hist;
+};
+
+static void* producerThread(void* arg) {
+    struct Producer* producer = (struct Producer*)arg;
+    struct GroupLog* log = producer->log;
+
+    histInit(&producer->hist);
+
+    for (long long i = 0; i < producer->numRecords; ++i) {
+        uint64_t start = timingNow();
+
+        pthread_mutex_lock(&log->lock);
+        memset(log->pending + (size_t)log->numPending * log->recordSize, (int)(i & 0xff), log->recordSize);
+        if (log->numPending++ == 0) {
+            log->firstPendingTime = start;
+            pthread_cond_signal(&log->recordAdded);
+        } else if (log->maxBatch > 0 && log->numPending >= log->maxBatch) {
+            pthread_cond_signal(&log->recordAdded);
+        }
+        long long sequence = ++log->appended;
+
+        while (log->durable < sequence) {
+            pthread_cond_wait(&log->committed, &log->lock);
+        }
+        pthread_mutex_unlock(&log->lock);
+
+        histRecord(&producer->hist, timingElapsed(start, timingNow()));
+    }
+
+    return NULL;
+}
+
+// Waits until the pending batch should be committed. Returns 0 once the log
+// is done and nothing is left to commit. Called with the lock held.
+static int waitForBatch(struct GroupLog* log) {
+    while (log->numPending == 0) {
+        if (log->done) {
+            return 0;
+        }
+        pthread_cond_wait(&log->recordAdded, &log->lock);
+    }
+
+    uint64_t deadline = log->firstPendingTime + (uint64_t)log->windowUs * 1000;
+    while (log->windowUs > 0 && !log->done && (log->maxBatch == 0 || log->numPending < log->maxBatch)) {
+        uint64_t now = timingNow();
+        if (now >= deadline) {
+            break;
+        }
+
+        struct timespec wake;
+        clock_gettime(CLOCK_MONOTONIC, &wake);
+        uint64_t wakeNs = wake.tv_nsec + (deadline - now);
+        wake.tv_sec += wakeNs / 1000000000ULL;
+        wake.tv_nsec = wakeNs % 1000000000ULL;
+        pthread_cond_timedwait(&log->recordAdded, &log->lock, &wake);
+    }
+
+    return 1;
+}
+
+static void* commitThread(void* arg) {
+    struct GroupLog* log = (struct GroupLog*)arg;
+
+    pthread_mutex_lock(&log->lock);
+    while (waitForBatch(log)) {
+        char* batch = log->pending;
+        int numRecords = log->numPending;
+        if (log->maxBatch > 0 && numRecords > log->maxBatch) {
+            numRecords = log->maxBatch;
+        }
+        int numLeft = log->numPending - numRecords;
+        long long lastSequence = log->appended - numLeft;
+
+        // Producers keep appending to the other buffer during the flush;
+        // records past the batch limit move there and open the next batch
+        memcpy(log->spare, batch + (size_t)numRecords * log->recordSize, (size_t)numLeft * log->recordSize);
+        log->pending = log->spare;
+        log->spare = batch;
+        log->numPending = numLeft;
+        pthread_mutex_unlock(&log->lock);
+
+        size_t length = (size_t)numRecords * log->recordSize;
+        if (pwrite(log->fd, batch, length, log->offset) != (ssize_t)length) {
+            perror("Error writing log");
+            exit(EXIT_FAILURE);
+        }
+        if (fdatasync(log->fd) == -1) {
+            perror("Error syncing log");
+            exit(EXIT_FAILURE);
+        }
+        log->offset += length;
+
+        pthread_mutex_lock(&log->lock);
+        log->durable = lastSequence;
+        log->batches++;
+        pthread_cond_broadcast(&log->committed);
+    }
+    pthread_mutex_unlock(&log->lock);
+
+    return NULL;
+}
+
+// Runs numProducers threads that each append recordsPerProducer records of
+// recordSize bytes to a log and wait for each one to be durable before the
+// next, while one commit thread groups them into fdatasync() batches. hist
+// gets the append-to-durable latency of every record. Returns wall-clock
+// seconds, or -1 if the log cannot be created.
+double measureGroupCommit(const char* filename, int recordSize, long long recordsPerProducer, int numProducers,
+                          int windowUs, int maxBatch, struct LatencyHistogram* hist, long long* batches) {
+    struct GroupLog log;
+    memset(&log, 0, sizeof(log));
+    log.recordSize = recordSize;
+    log.windowUs = windowUs;
+    log.maxBatch = maxBatch;
+
+    log.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (log.fd == -1) {
+        perror("Error opening log");
+        return -1;
+    }
+
+    // Like a real log, allocate up front so commits only flush data
+    long long totalBytes = (long long)recordSize * recordsPerProducer * numProducers;
+    if (fallocate(log.fd, 0, 0, totalBytes) == 0 && fsync(log.fd) == -1) {
+        perror("Error syncing log");
+        exit(EXIT_FAILURE);
+    }
+
+    // Each producer has at most one record outstanding
+    log.pending = poolAcquire((size_t)recordSize * numProducers);
+    log.spare = poolAcquire((size_t)recordSize * numProducers);
+
+    pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&log.lock, NULL);
+    pthread_cond_init(&log.recordAdded, &condAttr);
+    pthread_cond_init(&log.committed, NULL);
+    pthread_condattr_destroy(&condAttr);
+
+    pthread_t* threads = malloc(sizeof(pthread_t) * numProducers);
+    struct Producer* producers = malloc(sizeof(struct Producer) * numProducers);
+    if (threads == NULL || producers == NULL) {
+        perror("Error allocating thread data");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_t committer;
+    double start = timingSeconds();
+
+    if (pthread_create(&committer, NULL, commitThread, &log) != 0) {
+        perror("Error creating thread");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < numProducers; ++i) {
+        producers[i].log = &log;
+        producers[i].numRecords = recordsPerProducer;
+        if (pthread_create(&threads[i], NULL, producerThread, &producers[i]) != 0) {
+            perror("Error creating thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < numProducers; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_lock(&log.lock);
+    log.done = 1;
+    pthread_cond_signal(&log.recordAdded);
+    pthread_mutex_unlock(&log.lock);
+    pthread_join(committer, NULL);
+
+    double totalTime = timingSeconds() - start;
+
+    histInit(hist);
+    for (int i = 0; i < numProducers; ++i) {
+        histMerge(hist, &producers[i].hist);
+    }
+    *batches = log.batches;
+
+    pthread_cond_destroy(&log.committed);
+    pthread_cond_destroy(&log.recordAdded);
+    pthread_mutex_destroy(&log.lock);
+    free(producers);
+    free(threads);
+    poolRelease(log.spare);
+    poolRelease(log.pending);
+    close(log.fd);
+
+    return totalTime;
+}
+
+// Reads the file block by block and feeds every block to the checksum engine
+// as it arrives. Returns the wall-clock time of the whole read, or -1 if the
+// cache could not be prepared; computeTime receives the time spent in the
+// engine alone and value the checksum.
+double measureChecksum(const char* filename, int block_size, long long block_count, int engine, int mode,
+                       double* computeTime, uint64_t* value) {
+    if (!prepareCache(filename, mode)) {
+        return -1;
+    }
+
+    int fd = openForMode(filename, mode);
+    if (fd == -1) {
+        return -1;
+    }
+
+    char* buffer = poolAcquire(block_size);
+    struct ChecksumState state;
+    checksumInit(&state, engine);
+    uint64_t computeNs = 0;
+
+    double start = timingSeconds();
+
+    for (long long i = 0; i < block_count; ++i) {
+        ssize_t bytesRead = read(fd, buffer, block_size);
+        if (bytesRead == -1) {
+            perror("Error reading from file");
+            exit(EXIT_FAILURE);
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+
+        uint64_t computeStart = timingNow();
+        checksumUpdate(&state, buffer, bytesRead);
+        computeNs += timingElapsed(computeStart, timingNow());
+    }
+
+    double totalTime = timingSeconds() - start;
+
+    *computeTime = computeNs / 1e9;
+    *value = checksumFinal(&state);
+
+    poolRelease(buffer);
+    close(fd);
+
+    return totalTime;
+}
+
+// The file checksum is the XOR of the file taken as little-endian 64-bit
+// words, with the last partial word padded with zeros.
+
+// XOR of size bytes starting at a file offset that is a multiple of 8
+static uint64_t xorBlockScalar(const unsigned char* data, size_t size) {
+    uint64_t result = 0;
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        result ^= word;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, size - i);
+
+    return result ^ tail;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static uint64_t xorBlockSSE2(const unsigned char* data, size_t size) {
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 32 <= size; i += 32) {
+        acc0 = _mm_xor_si128(acc0, _mm_loadu_si128((const __m128i*)(data + i)));
+        acc1 = _mm_xor_si128(acc1, _mm_loadu_si128((const __m128i*)(data + i + 16)));
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, _mm_xor_si128(acc0, acc1));
+
+    return lanes[0] ^ lanes[1] ^ xorBlockScalar(data + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static uint64_t xorBlockAVX2(const unsigned char* data, size_t size) {
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 64 <= size; i += 64) {
+        acc0 = _mm256_xor_si256(acc0, _mm256_loadu_si256((const __m256i*)(data + i)));
+        acc1 = _mm256_xor_si256(acc1, _mm256_loadu_si256((const __m256i*)(data + i + 32)));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, _mm256_xor_si256(acc0, acc1));
+
+    return lanes[0] ^ lanes[1] ^ lanes[2] ^ lanes[3] ^ xorBlockScalar(data + i, size - i);
+}
+#endif
+
+typedef uint64_t (*XORKernel)(const unsigned char* data, size_t size);
+
+// Picks the widest XOR kernel the CPU supports
+static XORKernel selectXORKernel(const char** name) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "AVX2";
+        return xorBlockAVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        *name = "SSE2";
+        return xorBlockSSE2;
+    }
+#endif
+    *name = "scalar";
+    return xorBlockScalar;
+}
+
+struct XORThread {
+    const unsigned char* data;
+    size_t size;
+    XORKernel kernel;
+    uint64_t result;
+};
+
+static void* xorThread(void* arg) {
+    struct XORThread* data = (struct XORThread*)arg;
+    data->result = data->kernel(data->data, data->size);
+    return NULL;
+}
+
+// Maps the file and XORs it with numThreads threads over page-aligned ranges,
+// then reduces the partial results.
+uint64_t xorChecksum(const char* filename, int numThreads, const char** kernelName) {
+    XORKernel kernel = selectXORKernel(kernelName);
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("Error opening file for reading");
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == -1) {
+        perror("Error getting file information");
+        exit(EXIT_FAILURE);
+    }
+    if (fileStat.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    unsigned char* map = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Error mapping file for XOR calculation");
+        exit(EXIT_FAILURE);
+    }
+    // Advice values are not flags, each one needs its own call
+    madvise(map, fileStat.st_size, MADV_SEQUENTIAL);
+    madvise(map, fileStat.st_size, MADV_WILLNEED);
+
+    pthread_t* threads = malloc(sizeof(pthread_t) * numThreads);
+    struct XORThread* data = malloc(sizeof(struct XORThread) * numThreads);
+    if (threads == NULL || data == NULL) {
+        perror("Error allocating thread data");
+        exit(EXIT_FAILURE);
+    }
+
+    // Range boundaries stay on page boundaries, so every range starts on a word
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t numPages = (fileStat.st_size + pageSize - 1) / pageSize;
+
+    for (int i = 0; i < numThreads; ++i) {
+        size_t first = numPages * i / numThreads * pageSize;
+        size_t last = numPages * (i + 1) / numThreads * pageSize;
+        if (last > (size_t)fileStat.st_size) {
+            last = fileStat.st_size;
+        }
+
+        data[i].data = map + first;
+        data[i].size = last > first ? last - first : 0;
+        data[i].kernel = kernel;
+        data[i].result = 0;
+
+        if (pthread_create(&threads[i], NULL, xorThread, &data[i]) != 0) {
+            perror("Error creating thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    uint64_t result = 0;
+    for (int i = 0; i < numThreads; ++i) {
+        pthread_join(threads[i], NULL);
+        result ^= data[i].result;
+    }
+
+    free(data);
+    free(threads);
+    munmap(map, fileStat.st_size);
+    close(fd);
+
+    return result;
+}
+
+// Scalar reference: XORs every byte into its lane of the 64-bit result
+uint64_t xorChecksumReference(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("Error opening file for XOR calculation");
+        exit(EXIT_FAILURE);
+    }
+
+    unsigned char buffer[64 * KILOBYTE];
+    ssize_t bytesRead;
+    uint64_t result = 0;
+    uint64_t offset = 0;
+
+    while ((bytesRead = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < bytesRead; ++i, ++offset) {
+            result ^= (uint64_t)buffer[i] << (8 * (offset % 8));
+        }
+    }
+
+    if (bytesRead == -1) {
+        perror("Error reading from file for XOR calculation");
+        exit(EXIT_FAILURE);
+    }
+
+    close(fd);
+
+    return result;
+}
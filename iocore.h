@@ -0,0 +1,202 @@
+#ifndef IOCORE_H
+#define IOCORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "checksum.h"
+#include "counters.h"
+#include "timing.h"
+
+// Measurement core shared by the bench driver: read and write engines, page
+// cache control and the file checksum. I/O buffers come from the buffer pool
+// (bufpool.h), so poolSetPages() picks the pages every engine reads into.
+// Engines that take a PerfCounters pointer count events around their timed
+// loop (counters.h) when it is not NULL.
+// Functions print the reason and exit on unexpected errors, and return -1
+// when a run cannot be reported.
+
+#define KILOBYTE 1024
+#define MEGABYTE (KILOBYTE * KILOBYTE)
+
+#define MAX_COLD_RESIDENCY 0.01  // Largest resident fraction accepted as a cold cache
+#define EVICT_ATTEMPTS 3
+#define BUFFER_ALIGN 4096        // Alignment of every pool buffer, enough for O_DIRECT
+
+// Read modes
+#define READ_CACHED 0  // Whatever the page cache holds
+#define READ_COLD 1    // File evicted from the page cache before the run
+#define READ_DIRECT 2  // O_DIRECT, block size must be a multiple of the alignment
+
+// Chunking strategies of the parallel reader
+#define CHUNK_STATIC 0   // Each thread reads one contiguous range
+#define CHUNK_DYNAMIC 1  // Threads take fixed-size chunks from a shared counter
+
+// Thread placement of the parallel reader
+#define AFFINITY_NONE 0     // Left to the scheduler
+#define AFFINITY_COMPACT 1  // Fill the SMT siblings of a core before the next core
+#define AFFINITY_SCATTER 2  // One thread per core across packages before any sibling
+
+// Readahead policies of the sequential reader
+#define READAHEAD_KERNEL 0      // No advice, kernel default readahead
+#define READAHEAD_SEQUENTIAL 1  // POSIX_FADV_SEQUENTIAL
+#define READAHEAD_RANDOM 2      // POSIX_FADV_RANDOM, readahead off
+#define READAHEAD_NOREUSE 3     // POSIX_FADV_NOREUSE
+#define READAHEAD_WILLNEED 4    // POSIX_FADV_WILLNEED over the whole read up front
+#define READAHEAD_EXPLICIT 5    // readahead() calls from the reader, a window ahead
+#define READAHEAD_PREFETCH 6    // readahead() from a background thread, a window ahead
+
+#define READAHEAD_DEFAULT_WINDOW (4LL * MEGABYTE)
+
+// Write modes
+#define WRITE_BUFFERED 0  // Through the page cache
+#define WRITE_DIRECT 1    // O_DIRECT, block size must be a multiple of the alignment
+#define WRITE_DSYNC 2     // O_DSYNC, every write waits for the data to be durable
+
+// Durability policies applied while writing
+#define SYNC_NONE 0
+#define SYNC_FSYNC 1
+#define SYNC_FDATASYNC 2
+#define SYNC_PIPELINE 3  // sync_file_range() writeback trailing the writer by one window
+
+#define PIPELINE_DEFAULT_BLOCKS 256
+
+// Access patterns of the random reader
+#define PATTERN_SEQUENTIAL 0  // Each thread walks its own part of the file in order
+#define PATTERN_UNIFORM 1
+#define PATTERN_ZIPF 2        // Block of popularity rank k is read with probability ~ 1/k^skew
+#define PATTERN_HOTSET 3      // hotProbability of the reads go to hotFraction of the blocks
+
+// Layouts of a partially warmed page cache
+#define WARM_PREFIX 0   // The start of the file
+#define WARM_RANDOM 1   // Pages spread uniformly over the file
+#define WARM_STRIPED 2  // The same share of every stripe
+
+#define WARM_DEFAULT_STRIPE (1LL * MEGABYTE)
+#define WARM_CHUNK (1 * MEGABYTE)  // Largest read issued while warming
+
+#define TREE_FANOUT 16  // Subdirectories per level of a small-file tree
+
+#define MAX_LIST_VALUES 64
+
+extern const int defaultBlockSizes[];
+extern const int numDefaultBlockSizes;
+
+// When and how written data is made durable. everyBlocks is the flush
+// interval (the window size for SYNC_PIPELINE); 0 flushes once at the end.
+struct SyncPolicy {
+    int kind;
+    int everyBlocks;
+};
+
+struct ReadaheadPolicy {
+    int kind;
+    long long window;  // Bytes kept ahead of the reader by READAHEAD_EXPLICIT and READAHEAD_PREFETCH
+};
+
+struct AccessPattern {
+    int kind;
+    double skew;
+    double hotFraction;
+    double hotProbability;
+};
+
+struct WarmLayout {
+    int kind;
+    long long stripe;  // Bytes per stripe of WARM_STRIPED
+};
+
+// Files of a generated small-file tree, in creation order
+struct FileTree {
+    int numFiles;
+    char** paths;
+    int* sizes;
+    int maxSize;
+};
+
+// Syscalls made by a vectored read and, with RWF_NOWAIT, how its first
+// attempt at each batch fared against the page cache
+struct VectoredStats {
+    long long calls;
+    long long hits;     // Batch served entirely from the page cache
+    long long partial;  // Only the cached prefix was returned
+    long long misses;   // Nothing cached, the call would have blocked
+};
+
+// Fastest and slowest thread of a multithreaded read
+struct ThreadSkew {
+    double fastest;
+    double slowest;
+};
+
+int parseIntList(const char* list, int* values, int maxValues);
+int parseList(const char* list, int maxValues, int (*parse)(const char* token, int index, void* context),
+              void* context);
+int parseInteger(const char* text, long long min, long long max, long long* value);
+const char* readModeName(int mode);
+int parseReadMode(const char* name);
+
+const char* affinityName(int policy);
+int parseAffinity(const char* name);
+
+const char* writeModeName(int mode);
+int parseWriteMode(const char* name);
+int parseSyncPolicy(const char* name, struct SyncPolicy* policy);
+void syncPolicyName(const struct SyncPolicy* policy, char* name, size_t size);
+
+int parseReadaheadPolicy(const char* name, struct ReadaheadPolicy* policy);
+void readaheadPolicyName(const struct ReadaheadPolicy* policy, char* name, size_t size);
+int parseAccessPattern(const char* name, struct AccessPattern* pattern);
+void accessPatternName(const struct AccessPattern* pattern, char* name, size_t size);
+
+long long fileSize(const char* filename);
+
+double fileResidency(int fd);
+double clearDiskCache(const char* filename);
+int prepareCache(const char* filename, int mode);
+
+int directIOAlignment(const char* filename, int* memAlign, int* offsetAlign);
+int roundToAlignment(int block_size, int align);
+
+double measureReadTime(const char* filename, int block_size, long long block_count, int mode,
+                       const struct ReadaheadPolicy* policy, struct LatencyHistogram* hist,
+                       struct PerfCounters* counters);
+int uringAvailable(void);
+double measureReadTimeUring(const char* filename, int block_size, long long block_count, int queueDepth, int mode,
+                            struct PerfCounters* counters);
+double measureReadTimeVectored(const char* filename, int block_size, long long block_count, int iovecs,
+                               int nowait, int mode, struct LatencyHistogram* hist, struct VectoredStats* stats,
+                               struct PerfCounters* counters);
+int affinityOrder(int policy, int* cpus);
+double measureReadTimeParallel(const char* filename, int block_size, long long block_count, int numThreads,
+                               int strategy, int chunkBlocks, int mode, struct ThreadSkew* skew,
+                               struct PerfCounters* counters, const int* cpus, int numCpus);
+
+double measureRandomReadTime(const char* filename, int block_size, long long block_count, long long numReads,
+                             int numThreads, const struct AccessPattern* pattern, int mode,
+                             struct LatencyHistogram* hist, struct PerfCounters* counters);
+
+int parseWarmLayout(const char* name, struct WarmLayout* layout);
+void warmLayoutName(const struct WarmLayout* layout, char* name, size_t size);
+double warmFileFraction(const char* filename, double fraction, const struct WarmLayout* layout);
+
+void buildFileTree(const char* root, int numFiles, int depth, int minSize, int maxSize, struct FileTree* tree);
+void freeFileTree(struct FileTree* tree);
+double measureSmallFiles(const struct FileTree* tree, int numThreads, int mode, struct LatencyHistogram* hist,
+                         long long* bytes);
+double measureSmallFilesUring(const struct FileTree* tree, int batchSize, int mode, struct LatencyHistogram* hist,
+                              long long* bytes);
+
+double measureWriteTime(const char* filename, int block_size, long long block_count, int mode,
+                        const struct SyncPolicy* policy, int preallocate, struct LatencyHistogram* hist,
+                        struct PerfCounters* counters);
+
+double measureGroupCommit(const char* filename, int recordSize, long long recordsPerProducer, int numProducers,
+                          int windowUs, int maxBatch, struct LatencyHistogram* hist, long long* batches);
+
+double measureChecksum(const char* filename, int block_size, long long block_count, int engine, int mode,
+                       double* computeTime, uint64_t* value);
+
+uint64_t xorChecksum(const char* filename, int numThreads, const char** kernelName);
+uint64_t xorChecksumReference(const char* filename);
+
+#endif
@@ -1,139 +1,720 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
-#include <time.h>
+#include <sys/wait.h>
+#include "bufpool.h"
+#include "iocore.h"
+#include "timing.h"
+
+#define MIN_BLOCK_SIZE 512
+#define MAX_BLOCK_SIZE (64 * MEGABYTE)
+#define MIN_SAMPLE_BYTES (32LL * MEGABYTE)  // Data read by one sample of a small block size
+#define MIN_BLOCKS_PER_SAMPLE 4             // Large block sizes read at least this many blocks
+#define INITIAL_SAMPLES 5
+#define EXTRA_SAMPLES 5
+#define MAX_SAMPLES 30
+#define MAX_CANDIDATES 64
+#define MIN_REFINE_STEP 0.02  // Stop refining once neighbours are within 2% of the winner
+#define COMPARE_ROUNDS 5      // Alternating runs of our reader and dd
+#define GENERATE_CHUNK (4 * MEGABYTE)  // Unit of work of the test-file generator
+#define GENERATE_PAGE 4096              // Granularity of the compressible share
+#define GENERATE_LANES 8                // Random streams filling a page side by side
+
+// Throughput samples taken for one block size
+struct Candidate {
+    int block_size;
+    int samples;
+    double sum;
+    double sumSquares;
+};
+
+struct Candidate candidates[MAX_CANDIDATES];  // Kept sorted by block size
+int numCandidates = 0;
+long long maxFileSize = 1024LL * MEGABYTE;  // Largest size the test file may grow to
+int ddDirect = 0;     // iflag=direct for the dd comparison, set with -d
+int ddFullblock = 0;  // iflag=fullblock for the dd comparison, set with -F
+int ddExternal = 0;   // Also time the real dd binary, set with -x
+int compareCold = 0;  // Compare on a cold page cache instead of a warm one, set with -c
+long long generateOnly = 0;  // Write a test file of this size and exit, set in MiB with -G
+int generatorThreads = 0;    // Threads writing the test file, set with -g (0 = one per CPU)
+int compressiblePercent = 0;  // Share of every page that is zeros, set with -z
+// Seed of the test data, set with -S. Equal seeds give byte-identical files
+// whatever the thread count or the size the file was grown from.
+uint64_t dataSeed = 1;
+
+// What one dd-style run read and how long it took
+struct DDResult {
+    long long fullRecords;
+    long long partialRecords;
+    long long bytes;
+    double seconds;
+};
 
 void printUsage() {
-    printf("Usage: ./measurement <filename> <block_size>\n");
+    printf("Usage: ./measurement [-c] [-d] [-F] [-x] [-g threads] [-z percent] [-S seed] [-G size_MiB] <filename> [max_file_size_MiB]\n");
+    printf("  -c  Compare with dd on a cold page cache (default warm)\n");
+    printf("  -d  Compare with iflag=direct\n");
+    printf("  -F  Compare with iflag=fullblock\n");
+    printf("  -x  Also time the external dd binary\n");
+    printf("  -g  Threads generating the test file (default one per CPU)\n");
+    printf("  -z  Percent of every page of test data that is zeros (default 0, incompressible)\n");
+    printf("  -S  Seed of the test data (default 1)\n");
+    printf("  -G  Only write a fresh test file of this size and exit\n");
 }
 
-void generateRandomData(char* buffer, int size) {
-    for (int i = 0; i < size; ++i) {
-        buffer[i] = rand() % 256;  // Fill the buffer with random byte values (0-255)
+void printFileSize(int block_size, int block_count) {
+    double fileSizeKB = (double)block_size * block_count / 1024.0;
+    double fileSizeMB = fileSizeKB / 1024.0;
+
+    printf("File size: %d blocks, %.2f KB, %.2f MB\n", block_count, fileSizeKB, fileSizeMB);
+}
+
+// Next value of the splitmix64 sequence, used to seed the generator lanes
+uint64_t splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Fills one GENERATE_CHUNK with the data that belongs at chunk index chunk.
+// (100 - compressiblePercent)% of every page is random, the rest is zeros.
+// Every page is filled by GENERATE_LANES independent xorshift64 streams
+// seeded from splitmix64, interleaved word by word. GCC vectorizes the lane
+// loop at -O2 (16-byte vectors, 32-byte with -mavx2); a generator built on a
+// 128-bit multiply per word stays scalar.
+void generateChunk(uint64_t* words, long long chunk) {
+    // The seed is mixed before the chunk index is added, so the chunk
+    // streams of different seeds do not overlap
+    uint64_t seedState = dataSeed;
+    uint64_t state = splitmix64(&seedState) + (uint64_t)chunk;
+    int pageWords = GENERATE_PAGE / sizeof(uint64_t);
+    int randomWords = pageWords * (100 - compressiblePercent) / 100;
+
+    for (int page = 0; page < GENERATE_CHUNK / GENERATE_PAGE; ++page) {
+        uint64_t* p = words + (long long)page * pageWords;
+
+        uint64_t lanes[GENERATE_LANES];
+        for (int l = 0; l < GENERATE_LANES; ++l) {
+            lanes[l] = splitmix64(&state) | 1;  // xorshift never leaves zero
+        }
+
+        // Whole rounds of lanes; the zeros below overwrite any overshoot
+        for (int i = 0; i < randomWords; i += GENERATE_LANES) {
+            for (int l = 0; l < GENERATE_LANES; ++l) {
+                uint64_t x = lanes[l];
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                lanes[l] = x;
+                p[i + l] = x;
+            }
+        }
+        memset(p + randomWords, 0, (pageWords - randomWords) * sizeof(uint64_t));
+    }
+}
+
+// Part of the file the generator threads share
+struct GeneratorJob {
+    int fd;
+    long long start;  // First byte to write
+    long long end;    // File size to reach
+    long long nextChunk;
+};
+
+void* generatorThread(void* arg) {
+    struct GeneratorJob* job = (struct GeneratorJob*)arg;
+
+    // posix_memalign() returns the error instead of setting errno
+    void* buffer;
+    int ret = posix_memalign(&buffer, BUFFER_ALIGN, GENERATE_CHUNK);
+    if (ret != 0) {
+        fprintf(stderr, "Error allocating buffer: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
     }
+
+    long long lastChunk = (job->end - 1) / GENERATE_CHUNK;
+    long long chunk;
+    while ((chunk = __atomic_fetch_add(&job->nextChunk, 1, __ATOMIC_RELAXED)) <= lastChunk) {
+        generateChunk(buffer, chunk);
+
+        // The first and last chunk may only partly belong to the range
+        long long chunkStart = chunk * GENERATE_CHUNK;
+        long long from = chunkStart > job->start ? chunkStart : job->start;
+        long long to = chunkStart + GENERATE_CHUNK < job->end ? chunkStart + GENERATE_CHUNK : job->end;
+
+        while (from < to) {
+            ssize_t bytesWritten = pwrite(job->fd, (char*)buffer + (from - chunkStart), to - from, from);
+            if (bytesWritten == -1) {
+                perror("Error writing to file");
+                exit(EXIT_FAILURE);
+            }
+            from += bytesWritten;
+        }
+    }
+
+    free(buffer);
+    return NULL;
 }
 
-double measureReadTime(const char* filename, int block_size, int block_count) {
-    int fd = open(filename, O_RDONLY | O_APPEND);
+// Extends the file with generated data until it holds size bytes, keeping
+// whatever is already there. Creates the file if it does not exist. Returns
+// the MiB/s the new part was written at.
+double createFile(const char* filename, long long size) {
+    int fd = open(filename, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
     if (fd == -1) {
-        perror("Error opening file for reading");
+        perror("Error creating file");
         exit(EXIT_FAILURE);
     }
 
-    char buffer[block_size];
-    ssize_t bytesRead;
+    off_t offset = lseek(fd, 0, SEEK_END);
+    if (offset == -1) {
+        perror("Error seeking to end of file");
+        exit(EXIT_FAILURE);
+    }
+    if (offset >= size) {
+        close(fd);
+        return 0;
+    }
 
-    clock_t start, end;
-    double totalTime = 0;
+    double start = timingSeconds();
 
-    for (int i = 0; i < block_count; ++i) {
-        start = clock();
+    // Reserve the blocks up front so parallel writes do not fragment the
+    // file. Filesystems without fallocate() just allocate as they go.
+    if (fallocate(fd, 0, offset, size - offset) == -1 && errno != EOPNOTSUPP) {
+        perror("Error preallocating file");
+        exit(EXIT_FAILURE);
+    }
 
-        bytesRead = read(fd, buffer, block_size);
+    struct GeneratorJob job;
+    job.fd = fd;
+    job.start = offset;
+    job.end = size;
+    job.nextChunk = offset / GENERATE_CHUNK;
 
-        end = clock();
-        double elapsedTime = ((double)(end - start)) / CLOCKS_PER_SEC;
+    int numThreads = generatorThreads > 0 ? generatorThreads : sysconf(_SC_NPROCESSORS_ONLN);
+    long long numChunks = (size - 1) / GENERATE_CHUNK - job.nextChunk + 1;
+    if (numThreads > numChunks) {
+        numThreads = numChunks;
+    }
+    if (numThreads < 1) {
+        numThreads = 1;
+    }
 
-        if (bytesRead == -1) {
-            perror("Error reading from file");
+    pthread_t threads[numThreads];
+    for (int i = 0; i < numThreads; ++i) {
+        if (pthread_create(&threads[i], NULL, generatorThread, &job) != 0) {
+            perror("Error creating thread");
             exit(EXIT_FAILURE);
         }
-
-        totalTime += elapsedTime;
+    }
+    for (int i = 0; i < numThreads; ++i) {
+        pthread_join(threads[i], NULL);
     }
 
+    double totalTime = timingSeconds() - start;
     close(fd);
 
-    return totalTime;
+    return (double)(size - offset) / MEGABYTE / totalTime;
 }
 
-void printFileSize(int block_size, int block_count) {
-    double fileSizeKB = (double)block_size * block_count / 1024.0;
-    double fileSizeMB = fileSizeKB / 1024.0;
+// Bytes read by one throughput sample of the given block size
+long long sampleBytes(int block_size) {
+    long long bytes = (long long)MIN_BLOCKS_PER_SAMPLE * block_size;
+    return bytes > MIN_SAMPLE_BYTES ? bytes : MIN_SAMPLE_BYTES;
+}
 
-    printf("File size: %d blocks, %.2f KB, %.2f MB\n", block_count, fileSizeKB, fileSizeMB);
+// Reads sampleBytes() from the start of the file and returns MiB/s. The file
+// is grown first if it is too short, so no read ever runs into EOF.
+double sampleThroughput(const char* filename, int block_size) {
+    long long bytes = sampleBytes(block_size);
+    if (bytes > maxFileSize) {
+        bytes = maxFileSize / block_size * block_size;
+    }
+
+    struct stat fileStat;
+    if (stat(filename, &fileStat) == -1 || fileStat.st_size < bytes) {
+        printf("Growing %s to %.2f MB", filename, (double)bytes / MEGABYTE);
+        fflush(stdout);
+        printf(" at %.2f MiB/s\n", createFile(filename, bytes));
+    }
+
+    int block_count = bytes / block_size;
+    struct LatencyHistogram hist;
+    double totalTime = measureReadTime(filename, block_size, block_count, READ_CACHED, NULL, &hist, NULL);
+
+    return (double)block_size * block_count / MEGABYTE / totalTime;
+}
+
+double candidateMean(const struct Candidate* c) {
+    return c->sum / c->samples;
+}
+
+// Half-width of the 95% confidence interval of the mean
+double candidateInterval(const struct Candidate* c) {
+    // Two-sided 95% Student t quantiles for 1..29 degrees of freedom
+    static const double tTable[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045
+    };
+
+    if (c->samples < 2) {
+        return INFINITY;
+    }
+
+    double mean = candidateMean(c);
+    double variance = (c->sumSquares - c->samples * mean * mean) / (c->samples - 1);
+    if (variance < 0) {
+        variance = 0;
+    }
+
+    int df = c->samples - 1;
+    double t = df <= (int)(sizeof(tTable) / sizeof(tTable[0])) ? tTable[df - 1] : 1.96;
+
+    return t * sqrt(variance / c->samples);
+}
+
+// The winner is separated from a neighbour when their intervals do not overlap
+int isSeparated(const struct Candidate* best, const struct Candidate* other) {
+    if (other == NULL) {
+        return 1;
+    }
+    return candidateMean(best) - candidateInterval(best) > candidateMean(other) + candidateInterval(other);
+}
+
+void addSamples(const char* filename, struct Candidate* c, int samples) {
+    for (int i = 0; i < samples; ++i) {
+        double throughput = sampleThroughput(filename, c->block_size);
+        c->samples++;
+        c->sum += throughput;
+        c->sumSquares += throughput * throughput;
+    }
 }
 
-void createFile(const char* filename, int block_size, int block_count) {
-    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+// Measures a new block size and inserts it in order. Returns NULL if it was
+// already measured or there is no room left.
+struct Candidate* addCandidate(const char* filename, int block_size) {
+    int pos = 0;
+    while (pos < numCandidates && candidates[pos].block_size < block_size) {
+        pos++;
+    }
+    if ((pos < numCandidates && candidates[pos].block_size == block_size) || numCandidates == MAX_CANDIDATES) {
+        return NULL;
+    }
+
+    memmove(&candidates[pos + 1], &candidates[pos], sizeof(struct Candidate) * (numCandidates - pos));
+    numCandidates++;
+
+    struct Candidate* c = &candidates[pos];
+    memset(c, 0, sizeof(*c));
+    c->block_size = block_size;
+
+    sampleThroughput(filename, block_size);  // Warm-up run, not recorded
+    addSamples(filename, c, INITIAL_SAMPLES);
+
+    printf("Block Size : %9d , %.2f MiB/s +/- %.2f\n", block_size, candidateMean(c), candidateInterval(c));
+
+    return c;
+}
+
+// Number of measured sizes the winner cannot be told apart from
+int countRivals(int best) {
+    int rivals = 0;
+    for (int i = 0; i < numCandidates; ++i) {
+        if (i != best && !isSeparated(&candidates[best], &candidates[i])) {
+            rivals++;
+        }
+    }
+    return rivals;
+}
+
+int findBest() {
+    int best = 0;
+    for (int i = 1; i < numCandidates; ++i) {
+        if (candidateMean(&candidates[i]) > candidateMean(&candidates[best])) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Geometric sweep over powers of two, then refinement around the winner with
+// geometric midpoints until it is statistically separated from every other
+// size or neither more resolution nor more samples can be had.
+// Returns the index of the winning candidate.
+int autotuneBlockSize(const char* filename) {
+    printf("\nCoarse sweep:\n");
+    for (long long block_size = MIN_BLOCK_SIZE; block_size <= MAX_BLOCK_SIZE; block_size *= 2) {
+        if (block_size * MIN_BLOCKS_PER_SAMPLE > maxFileSize) {
+            break;
+        }
+        addCandidate(filename, block_size);
+    }
+
+    printf("\nRefinement:\n");
+    for (;;) {
+        int best = findBest();
+        int bestSize = candidates[best].block_size;
+
+        // Pick midpoints first, inserting candidates moves the array around
+        int mids[2];
+        int numMids = 0;
+        for (int i = best - 1; i <= best + 1; i += 2) {
+            if (i < 0 || i >= numCandidates || isSeparated(&candidates[best], &candidates[i])) {
+                continue;
+            }
+            int mid = (int)sqrt((double)bestSize * candidates[i].block_size);
+            if (fabs((double)mid - bestSize) / bestSize >= MIN_REFINE_STEP && mid != candidates[i].block_size) {
+                mids[numMids++] = mid;
+            }
+        }
+
+        // Narrow the gap to every neighbour the winner cannot be told apart from
+        int progressed = 0;
+        for (int i = 0; i < numMids; ++i) {
+            progressed |= addCandidate(filename, mids[i]) != NULL;
+        }
+        if (progressed) {
+            continue;
+        }
+
+        // Out of resolution: spend samples on the winner and every size it is not separated from
+        best = findBest();
+        if (countRivals(best) == 0) {
+            break;
+        }
+        for (int i = 0; i < numCandidates; ++i) {
+            if ((i == best || !isSeparated(&candidates[best], &candidates[i])) && candidates[i].samples < MAX_SAMPLES) {
+                addSamples(filename, &candidates[i], EXTRA_SAMPLES);
+                progressed = 1;
+            }
+        }
+        if (!progressed) {
+            break;
+        }
+    }
+
+    return findBest();
+}
+
+// Puts the file in the page cache state the comparison runs in: fully
+// cached, or evicted when compareCold is set
+void prepareCacheState(const char* filename) {
+    if (compareCold) {
+        double residency = clearDiskCache(filename);
+        if (residency > MAX_COLD_RESIDENCY) {
+            fprintf(stderr, "Cache eviction failed: %.1f%% of %s still resident\n", residency * 100, filename);
+        }
+        return;
+    }
+
+    int fd = open(filename, O_RDONLY);
     if (fd == -1) {
-        perror("Error creating file");
+        perror("Error opening file for cache preparation");
+        exit(EXIT_FAILURE);
+    }
+
+    char* buffer = malloc(MEGABYTE);
+    if (buffer == NULL) {
+        perror("Error allocating buffer");
         exit(EXIT_FAILURE);
     }
+    while (read(fd, buffer, MEGABYTE) > 0) {
+    }
+    free(buffer);
+
+    close(fd);
+}
 
-    char buffer[block_size];
+// Reproduces dd if=filename of=/dev/null bs=block_size count=block_count in
+// this process, with iflag=direct and iflag=fullblock when set. Like dd, a
+// short read counts as a partial record unless fullblock keeps reading to
+// fill it, and every record is written to /dev/null.
+void ddRead(const char* filename, int block_size, int block_count, struct DDResult* result) {
+    double start = timingSeconds();
 
+    int fd = open(filename, O_RDONLY | (ddDirect ? O_DIRECT : 0));
+    if (fd == -1) {
+        perror("Error opening file for dd");
+        exit(EXIT_FAILURE);
+    }
+    int out = open("/dev/null", O_WRONLY);
+    if (out == -1) {
+        perror("Error opening /dev/null");
+        exit(EXIT_FAILURE);
+    }
+
+    // iflag=direct may need more than a page of alignment
+    int align = BUFFER_ALIGN;
+    int memAlign, offsetAlign;
+    if (ddDirect && directIOAlignment(filename, &memAlign, &offsetAlign) && memAlign > align) {
+        align = memAlign;
+    }
+
+    void* buffer;
+    int ret = posix_memalign(&buffer, align, block_size);
+    if (ret != 0) {
+        fprintf(stderr, "Error allocating buffer: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+
+    memset(result, 0, sizeof(*result));
     for (int i = 0; i < block_count; ++i) {
-        generateRandomData(buffer, block_size);  // Fill the buffer with random data
-        ssize_t bytesWritten = write(fd, buffer, block_size);
-        if (bytesWritten == -1) {
-            perror("Error writing to file");
+        ssize_t got = 0;
+        do {
+            ssize_t bytesRead = read(fd, (char*)buffer + got, block_size - got);
+            if (bytesRead == -1) {
+                perror("Error reading file for dd");
+                exit(EXIT_FAILURE);
+            }
+            if (bytesRead == 0) {
+                break;
+            }
+            got += bytesRead;
+        } while (ddFullblock && got < block_size);
+
+        if (got == 0) {
+            break;
+        }
+        if (got == block_size) {
+            result->fullRecords++;
+        } else {
+            result->partialRecords++;
+        }
+        result->bytes += got;
+
+        if (write(out, buffer, got) != got) {
+            perror("Error writing to /dev/null");
             exit(EXIT_FAILURE);
         }
     }
 
+    free(buffer);
+    close(out);
     close(fd);
+
+    result->seconds = timingSeconds() - start;
 }
 
-int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        printUsage();
-        return EXIT_FAILURE;
+// Runs the dd binary with the same arguments and returns its wall-clock
+// time, with its CPU time in usage. Returns -1 if dd did not succeed.
+double runExternalDD(const char* filename, int block_size, int block_count, struct rusage* usage) {
+    char ifArg[4096], bsArg[32], countArg[32], iflagArg[32];
+    snprintf(ifArg, sizeof(ifArg), "if=%s", filename);
+    snprintf(bsArg, sizeof(bsArg), "bs=%d", block_size);
+    snprintf(countArg, sizeof(countArg), "count=%d", block_count);
+    snprintf(iflagArg, sizeof(iflagArg), "iflag=%s%s%s", ddDirect ? "direct" : "",
+             ddDirect && ddFullblock ? "," : "", ddFullblock ? "fullblock" : "");
+
+    fflush(stdout);
+    double start = timingSeconds();
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("Error starting dd");
+        exit(EXIT_FAILURE);
     }
-
-    const char* filename = argv[1];
-    int block_size = atoi(argv[2]);
-
-    // Measure time for initial file size
-    struct stat fileStat;
-    if (stat(filename, &fileStat) == -1) {
-        perror("Error getting file information");
-        return EXIT_FAILURE;
+    if (pid == 0) {
+        // dd reports its own statistics on stderr; ours are printed instead
+        int devNull = open("/dev/null", O_WRONLY);
+        if (devNull != -1) {
+            dup2(devNull, STDERR_FILENO);
+        }
+        if (ddDirect || ddFullblock) {
+            execlp("dd", "dd", ifArg, "of=/dev/null", bsArg, countArg, iflagArg, (char*)NULL);
+        } else {
+            execlp("dd", "dd", ifArg, "of=/dev/null", bsArg, countArg, (char*)NULL);
+        }
+        _exit(127);
     }
 
-    int initialBlockCount = fileStat.st_size / block_size;
+    int status;
+    if (wait4(pid, &status, 0, usage) == -1) {
+        perror("Error waiting for dd");
+        exit(EXIT_FAILURE);
+    }
+    double totalTime = timingSeconds() - start;
 
-    double initialTime = measureReadTime(filename, block_size, initialBlockCount);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return -1;
+    }
+    return totalTime;
+}
 
-    printf("Initial file size: %d blocks\n", initialBlockCount);
-    printFileSize(block_size, initialBlockCount);
-    printf("Time taken for initial file size: %.2f seconds\n", initialTime);
+double rusageSeconds(const struct timeval* tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
 
-    int block_count = initialBlockCount;
-    double totalTime;
+// Times our reader and the dd reproduction back to back on the same cache
+// state, alternating the order so neither always runs second
+void compareWithDD(const char* filename, int block_size, int block_count) {
+    double dataMB = (double)block_size * block_count / MEGABYTE;
+    double oursSum = 0.0, ddSum = 0.0, externalSum = 0.0;
+    int externalRuns = 0;
+    struct DDResult dd;
+
+    printf("\nComparing with dd if=%s of=/dev/null bs=%d count=%d%s%s%s on a %s cache:\n",
+           filename, block_size, block_count,
+           ddDirect || ddFullblock ? " iflag=" : "", ddDirect ? "direct" : "",
+           ddFullblock ? (ddDirect ? ",fullblock" : "fullblock") : "",
+           compareCold ? "cold" : "warm");
+
+    for (int round = 0; round < COMPARE_ROUNDS; ++round) {
+        double ours = 0.0;
+        for (int turn = 0; turn < 2; ++turn) {
+            prepareCacheState(filename);
+            if ((round + turn) % 2 == 0) {
+                struct LatencyHistogram hist;
+                double start = timingSeconds();
+                measureReadTime(filename, block_size, block_count, ddDirect ? READ_DIRECT : READ_CACHED, NULL, &hist,
+                                NULL);
+                ours = timingSeconds() - start;
+            } else {
+                ddRead(filename, block_size, block_count, &dd);
+            }
+        }
+        oursSum += ours;
+        ddSum += dd.seconds;
+
+        printf("Round %d: ours %.2f MiB/s, in-process dd %.2f MiB/s", round + 1,
+               dataMB / ours, (double)dd.bytes / MEGABYTE / dd.seconds);
+
+        if (ddExternal) {
+            struct rusage usage;
+            prepareCacheState(filename);
+            double external = runExternalDD(filename, block_size, block_count, &usage);
+            if (external < 0) {
+                printf(", dd binary failed");
+            } else {
+                printf(", dd binary %.2f MiB/s (user %.3f s, sys %.3f s)", dataMB / external,
+                       rusageSeconds(&usage.ru_utime), rusageSeconds(&usage.ru_stime));
+                externalSum += external;
+                externalRuns++;
+            }
+        }
+        printf("\n");
+    }
 
-    // Keep doubling the file size until the time is within the specified range
-    do {
-        block_count *= 2;
-        totalTime = measureReadTime(filename, block_size, block_count);
-    } while (totalTime < 5.0 || totalTime > 15.0);
+    printf("dd records in: %lld+%lld\n", dd.fullRecords, dd.partialRecords);
+    printf("Mean wall-clock: ours %.6f s, in-process dd %.6f s", oursSum / COMPARE_ROUNDS, ddSum / COMPARE_ROUNDS);
+    if (externalRuns > 0) {
+        printf(", dd binary %.6f s", externalSum / externalRuns);
+    }
+    printf("\n");
+}
 
-    printf("Final file block count : %d blocks\n", block_count);
-    printFileSize(block_size, block_count);
-    printf("Time taken for final file size: %.2f seconds\n", totalTime);
+int main(int argc, char* argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "cdFxg:z:S:G:")) != -1) {
+        switch (opt) {
+            case 'c':
+                compareCold = 1;
+                break;
+            case 'd':
+                ddDirect = 1;
+                break;
+            case 'F':
+                ddFullblock = 1;
+                break;
+            case 'x':
+                ddExternal = 1;
+                break;
+            case 'g':
+                if ((generatorThreads = atoi(optarg)) <= 0) {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'z':
+                compressiblePercent = atoi(optarg);
+                if (compressiblePercent < 0 || compressiblePercent > 100) {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'S':
+                dataSeed = strtoull(optarg, NULL, 0);
+                break;
+            case 'G':
+                if ((generateOnly = atoll(optarg) * MEGABYTE) <= 0) {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                printUsage();
+                return EXIT_FAILURE;
+        }
+    }
 
-    // Save the file with the optimal size as "optimal_file_size.file"
-    
-    printf("\nSaving the file as 'optimal_file_size.file'\n");
-    createFile("optimal_file_size.file", block_size, block_count);
+    if (argc - optind != 1 && argc - optind != 2) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
 
-    // Now, let's compare with dd command on temp.txt with the final size
-    printf("\nComparing with dd command in linux :\n");
+    const char* filename = argv[optind];
+    if (argc - optind == 2) {
+        maxFileSize = atoll(argv[optind + 1]) * MEGABYTE;
+        if (maxFileSize < MIN_SAMPLE_BYTES) {
+            fprintf(stderr, "max_file_size_MiB must be at least %lld\n", MIN_SAMPLE_BYTES / MEGABYTE);
+            return EXIT_FAILURE;
+        }
+    }
+    timingInit();
 
-    char ddCommand[1024];
-    snprintf(ddCommand, sizeof(ddCommand), "dd if=optimal_file_size.file of=/dev/null bs=%d count=%d", block_size, block_count);
+    if (generateOnly) {
+        if (truncate(filename, 0) == -1 && errno != ENOENT) {
+            perror("Error truncating file");
+            exit(EXIT_FAILURE);
+        }
+        double rate = createFile(filename, generateOnly);
+        printf("Wrote %s: %.2f MB at %.2f MiB/s\n", filename, (double)generateOnly / MEGABYTE, rate);
+        return 0;
+    }
 
-    clock_t start_dd, end_dd;
-    double time_dd;
+    int best = autotuneBlockSize(filename);
+    struct Candidate* winner = &candidates[best];
+
+    int block_size = winner->block_size;
+    int block_count = sampleBytes(block_size) / block_size;
+    double mean = candidateMean(winner);
+    double interval = candidateInterval(winner);
+
+    printf("\nRecommended block size: %d bytes\n", block_size);
+    printf("Throughput: %.2f MiB/s, 95%% confidence interval [%.2f, %.2f] over %d samples\n",
+           mean, mean - interval, mean + interval, winner->samples);
+    if (countRivals(best) == 0) {
+        printf("Statistically separated from every other block size tested\n");
+    } else {
+        printf("Not separated from:");
+        for (int i = 0; i < numCandidates; ++i) {
+            if (i != best && !isSeparated(winner, &candidates[i])) {
+                printf(" %d", candidates[i].block_size);
+            }
+        }
+        printf("\n");
+    }
+    printFileSize(block_size, block_count);
 
-    start_dd = clock();
-    system(ddCommand);
-    end_dd = clock();
+    // O_DIRECT needs a block size the filesystem accepts
+    int memAlign, offsetAlign;
+    if (ddDirect && directIOAlignment(filename, &memAlign, &offsetAlign) && block_size % offsetAlign != 0) {
+        block_size = roundToAlignment(block_size, offsetAlign);
+        block_count = sampleBytes(block_size) / block_size;
+        printf("Using block size %d for iflag=direct\n", block_size);
+    }
 
-    time_dd = ((double)(end_dd - start_dd)) / CLOCKS_PER_SEC;
+    compareWithDD(filename, block_size, block_count);
 
     return 0;
 }
@@ -0,0 +1,248 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "membw.h"
+#include "timing.h"
+
+#define OP_COPY 0
+#define OP_READ 1
+
+static const long bufferSizes[MEMBW_NUM_SIZES] = {16L << 10, 256L << 10, 2L << 20, 16L << 20, 64L << 20, 256L << 20};
+
+static int calibratedThreads = 1;
+static long ceilingSize = 0;  // Per-thread buffer of the ceiling, 0 before memoryCalibrate()
+static long memoryBudget = 0;
+
+// memcpy MiB/s at ceilingSize for every thread count measured so far
+static int ceilingThreads[MEMBW_MAX_CEILINGS];
+static double ceilingCopy[MEMBW_MAX_CEILINGS];
+static int numCeilings = 0;
+
+struct BandwidthThread {
+    int op;
+    long size;
+    long long passBytes;
+    pthread_barrier_t* barrier;
+    double seconds;  // Best pass
+    uint64_t sink;   // Keeps the read loop from being optimised away
+};
+
+// Sums the buffer as 64-bit words with independent accumulators, so the
+// loads are the only limit
+static uint64_t readBuffer(const uint64_t* data, long words) {
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (long i = 0; i + 3 < words; i += 4) {
+        s0 += data[i];
+        s1 += data[i + 1];
+        s2 += data[i + 2];
+        s3 += data[i + 3];
+    }
+    return s0 ^ s1 ^ s2 ^ s3;
+}
+
+static void* bandwidthThread(void* arg) {
+    struct BandwidthThread* data = (struct BandwidthThread*)arg;
+
+    // Cache line aligned. posix_memalign() returns the error instead of
+    // setting errno.
+    char* src;
+    char* dst = NULL;
+    int ret = posix_memalign((void**)&src, 64, data->size);
+    if (ret == 0 && data->op == OP_COPY) {
+        ret = posix_memalign((void**)&dst, 64, data->size);
+    }
+    if (ret != 0) {
+        fprintf(stderr, "Error allocating calibration buffer: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+    // Fault every page in before timing
+    memset(src, 1, data->size);
+    if (dst != NULL) {
+        memset(dst, 0, data->size);
+    }
+
+    long repeats = data->passBytes / data->size > 0 ? data->passBytes / data->size : 1;
+    data->seconds = 0.0;
+    data->sink = 0;
+
+    for (int pass = 0; pass < MEMBW_PASSES; ++pass) {
+        pthread_barrier_wait(data->barrier);
+
+        double start = timingSeconds();
+        for (long r = 0; r < repeats; ++r) {
+            if (data->op == OP_COPY) {
+                memcpy(dst, src, data->size);
+                __asm__ volatile("" : : "r"(dst) : "memory");
+            } else {
+                data->sink += readBuffer((const uint64_t*)src, data->size / sizeof(uint64_t));
+            }
+        }
+        double seconds = timingSeconds() - start;
+
+        if (data->seconds == 0.0 || seconds < data->seconds) {
+            data->seconds = seconds;
+        }
+    }
+
+    free(src);
+    free(dst);
+    return NULL;
+}
+
+// Runs op on numThreads threads, each on its own buffer of size bytes, and
+// returns the seconds of the best pass, with the bytes all threads moved in
+// it in *bytes
+static double measureBandwidth(int op, long size, int numThreads, long long* bytes) {
+    pthread_t threads[numThreads];
+    struct BandwidthThread data[numThreads];
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, numThreads);
+
+    for (int i = 0; i < numThreads; ++i) {
+        data[i].op = op;
+        data[i].size = size;
+        data[i].passBytes = MEMBW_PASS_BYTES;
+        data[i].barrier = &barrier;
+        if (pthread_create(&threads[i], NULL, bandwidthThread, &data[i]) != 0) {
+            perror("Error creating thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double slowest = 0.0;
+    *bytes = 0;
+    for (int i = 0; i < numThreads; ++i) {
+        pthread_join(threads[i], NULL);
+        if (data[i].seconds > slowest) {
+            slowest = data[i].seconds;
+        }
+        long repeats = data[i].passBytes / size > 0 ? data[i].passBytes / size : 1;
+        *bytes += (long long)repeats * size;
+    }
+    pthread_barrier_destroy(&barrier);
+
+    return slowest;
+}
+
+// Shrinks the per-thread buffer so numThreads sources and destinations fit
+// in the budget
+static long threadBufferSize(long size, int numThreads) {
+    long limit = memoryBudget / (2L * numThreads);
+    limit -= limit % 64;
+    if (limit < 4096) {
+        limit = 4096;
+    }
+    return size > limit ? limit : size;
+}
+
+static void printSize(long size) {
+    if (size >= 1L << 20) {
+        printf("%ld MiB", size >> 20);
+    } else {
+        printf("%ld KiB", size >> 10);
+    }
+}
+
+static void rememberCeiling(int numThreads, double copy) {
+    if (numCeilings < MEMBW_MAX_CEILINGS) {
+        ceilingThreads[numCeilings] = numThreads;
+        ceilingCopy[numCeilings] = copy;
+        ++numCeilings;
+    }
+}
+
+int memoryCalibrate(long budget, struct BandwidthPoint* points) {
+    calibratedThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (calibratedThreads < 1) {
+        calibratedThreads = 1;
+    }
+    memoryBudget = budget;
+    numCeilings = 0;
+    ceilingSize = 0;
+
+    int count = 0;
+    for (int i = 0; i < MEMBW_NUM_SIZES; ++i) {
+        // Sizes whose source and destination do not fit in the budget are skipped
+        if (bufferSizes[i] * 2 > budget) {
+            break;
+        }
+        ceilingSize = bufferSizes[i];
+    }
+    if (ceilingSize == 0) {
+        fprintf(stderr, "Memory budget of %ld bytes is too small to calibrate\n", budget);
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < MEMBW_NUM_SIZES && bufferSizes[i] <= ceilingSize; ++i) {
+        int runs[2] = {1, calibratedThreads};
+        for (int r = 0; r < (calibratedThreads > 1 ? 2 : 1); ++r) {
+            struct BandwidthPoint* point = &points[count++];
+            point->threads = runs[r];
+            point->size = threadBufferSize(bufferSizes[i], runs[r]);
+            point->bytes = 0;
+            point->copySeconds = measureBandwidth(OP_COPY, point->size, runs[r], &point->bytes);
+            point->readSeconds = measureBandwidth(OP_READ, point->size, runs[r], &point->bytes);
+
+            if (bufferSizes[i] == ceilingSize) {
+                rememberCeiling(runs[r], point->copySeconds > 0 ? point->bytes / (1024.0 * 1024) / point->copySeconds : 0.0);
+            }
+        }
+    }
+    return count;
+}
+
+void printMemoryCalibration(const struct BandwidthPoint* points, int count) {
+    printf("\nMemory bandwidth (MiB/s, memcpy counts bytes copied, buffers within %ld MiB):\n\n", memoryBudget >> 20);
+    printf("Buffer\t\tThreads\t\tmemcpy\t\tread\n");
+
+    for (int i = 0; i < count; ++i) {
+        const struct BandwidthPoint* point = &points[i];
+        double megabytes = point->bytes / (1024.0 * 1024);
+        printSize(point->size);
+        printf("\t\t%d\t\t%.0f\t\t%.0f\n", point->threads, point->copySeconds > 0 ? megabytes / point->copySeconds : 0.0,
+               point->readSeconds > 0 ? megabytes / point->readSeconds : 0.0);
+    }
+
+    printf("\nReads below are also given as a share of the ");
+    printSize(ceilingSize);
+    printf(" memcpy bandwidth at their own thread count\n\n");
+}
+
+int memoryCalibrated(void) {
+    return ceilingSize > 0;
+}
+
+double memoryCeiling(int numThreads) {
+    if (ceilingSize == 0 || numThreads < 1) {
+        return 0.0;
+    }
+    for (int i = 0; i < numCeilings; ++i) {
+        if (ceilingThreads[i] == numThreads) {
+            return ceilingCopy[i];
+        }
+    }
+
+    long long bytes = 0;
+    double seconds = measureBandwidth(OP_COPY, threadBufferSize(ceilingSize, numThreads), numThreads, &bytes);
+    double copy = seconds > 0 ? bytes / (1024.0 * 1024) / seconds : 0.0;
+    rememberCeiling(numThreads, copy);
+    return copy;
+}
+
+double memoryFraction(double mibPerSec, int numThreads) {
+    double ceiling = memoryCeiling(numThreads);
+    return ceiling > 0 ? mibPerSec / ceiling : 0.0;
+}
+
+void printMemoryFraction(double mibPerSec, int numThreads) {
+    if (memoryCeiling(numThreads) <= 0) {
+        return;
+    }
+    printf("Memory bandwidth share: %.1f%% of memcpy at %d thread%s (%.0f MiB/s)\n",
+           100 * memoryFraction(mibPerSec, numThreads), numThreads, numThreads > 1 ? "s" : "",
+           memoryCeiling(numThreads));
+}
@@ -0,0 +1,42 @@
+#ifndef MEMBW_H
+#define MEMBW_H
+
+// Memory bandwidth calibration, run on request. memoryCalibrate() measures
+// memcpy and read-only streaming bandwidth of this host from L1-sized
+// buffers up to the largest size the memory budget allows, on one thread and
+// on every online CPU. File read results can then be reported as a share of
+// the memcpy bandwidth at the largest size, which is what a page cache read
+// costs at best, measured at the thread count of the read.
+
+#define MEMBW_NUM_SIZES 6
+#define MEMBW_MAX_POINTS (2 * MEMBW_NUM_SIZES)
+#define MEMBW_PASS_BYTES (256L << 20)  // Bytes moved per timed pass
+#define MEMBW_PASSES 3                 // Best of this many passes is kept
+#define MEMBW_MAX_CEILINGS 64          // Thread counts whose ceiling is kept
+
+// One row of the calibration: both kernels at one buffer size
+struct BandwidthPoint {
+    long size;         // Buffer bytes per thread
+    int threads;
+    long long bytes;   // Bytes moved by every thread together in one pass
+    double copySeconds;
+    double readSeconds;
+};
+
+// Runs the calibration with at most budget bytes of buffers (source and
+// destination of every thread together). Fills points and returns how many
+// there are.
+int memoryCalibrate(long budget, struct BandwidthPoint* points);
+void printMemoryCalibration(const struct BandwidthPoint* points, int count);
+int memoryCalibrated(void);
+
+// memcpy bandwidth at the largest calibrated size in MiB/s with numThreads
+// threads, measured on first use for thread counts the table lacks. 0 when
+// memoryCalibrate() was not run.
+double memoryCeiling(int numThreads);
+
+// Share of the memcpy ceiling at numThreads that a read of mibPerSec reaches
+double memoryFraction(double mibPerSec, int numThreads);
+void printMemoryFraction(double mibPerSec, int numThreads);
+
+#endif
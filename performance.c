@@ -1,50 +1,26 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
-#include <time.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "bufpool.h"
+#include "iocore.h"
+#include "membw.h"
+#include "timing.h"
 
-#define KILOBYTE 1024
-#define MEGABYTE (KILOBYTE * KILOBYTE)
+int compareHugePages = 0;  // Compare buffer page sizes at large block sizes, set with -H
+long memoryBudget = 0;  // Buffer bytes for the memory bandwidth calibration, set in MiB with -M
 
 void printUsage() {
-    printf("Usage: ./performance_measurement <filename>\n");
-}
-
-double measureReadTime(const char* filename, int block_size, int block_count) {
-    int fd = open(filename, O_RDONLY | O_APPEND);
-    if (fd == -1) {
-        perror("Error opening file for reading");
-        exit(EXIT_FAILURE);
-    }
-
-    char buffer[block_size];
-    ssize_t bytesRead;
-
-    clock_t start, end;
-    double totalTime = 0;
-
-    for (int i = 0; i < block_count; ++i) {
-        start = clock();
-
-        bytesRead = read(fd, buffer, block_size);
-
-        end = clock();
-        double elapsedTime = ((double)(end - start)) / CLOCKS_PER_SEC;
-
-        if (bytesRead == -1) {
-            perror("Error reading from file");
-            exit(EXIT_FAILURE);
-        }
-
-        totalTime += elapsedTime;
-    }
-
-    close(fd);
-
-    return totalTime;
+    printf("Usage: ./performance_measurement [-p 4k|thp|hugetlb] [-H] [-M MiB] <filename>\n");
+    printf("  -p  Pages backing the read buffer (default 4k)\n");
+    printf("  -H  Compare 4k, thp and hugetlb buffers at block sizes up to 1 GiB\n");
+    printf("  -M  Calibrate memory bandwidth with up to MiB of buffers, reads are then given as a share of it\n");
 }
 
 void printFileSize(int block_size, int block_count) {
@@ -55,7 +31,8 @@ void printFileSize(int block_size, int block_count) {
 }
 
 void printPerformance(const char* filename, int block_size, int block_count) {
-    double totalTime = measureReadTime(filename, block_size, block_count);
+    struct LatencyHistogram hist;
+    double totalTime = measureReadTime(filename, block_size, block_count, READ_CACHED, NULL, &hist, NULL);
 
     // Calculate performance in MiB/s
     double totalDataSizeMB = (double)block_size * block_count / MEGABYTE;
@@ -63,12 +40,11 @@ void printPerformance(const char* filename, int block_size, int block_count) {
 
     printf("Time taken to read: %.2f seconds\n", totalTime);
     printf("Performance: %.2f MiB/s\n", performance);
+    printMemoryFraction(performance, 1);
+    histPrint(&hist);
 }
 
 void runTestCases(const char* filename) {
-    int blockSizes[] = {512, 1024, 1028, 1400, 1424,1600, 1720, 1800, 2000, 2048, 2400};
-    int numBlockSizes = sizeof(blockSizes) / sizeof(blockSizes[0]);
-
     printf("\nBlock Size\tPerformance (MiB/s)\n\n");
 
     struct stat fileStat;
@@ -77,8 +53,8 @@ void runTestCases(const char* filename) {
         exit(EXIT_FAILURE);
     }
 
-    for (int i = 0; i < numBlockSizes; ++i) {
-        int block_size = blockSizes[i];
+    for (int i = 0; i < numDefaultBlockSizes; ++i) {
+        int block_size = defaultBlockSizes[i];
         int block_count = fileStat.st_size / block_size;
 
         // Perform test case
@@ -88,13 +64,134 @@ void runTestCases(const char* filename) {
     }
 }
 
+// Opens a counter of data TLB read misses for this thread, -1 if the CPU or
+// the kernel does not provide one
+int openTLBCounter() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_hv = 1;
+
+    int fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd == -1) {
+        // Restricted perf_event_paranoid still allows user space counting
+        attr.exclude_kernel = 1;
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    return fd;
+}
+
+// Reads the cached file with buffers on each kind of page at block sizes
+// where the copy into the buffer crosses many pages, and prints throughput
+// and data TLB misses per MiB. The file is read once first so every run
+// copies from the page cache.
+void runHugePageComparison(const char* filename) {
+    long long blockSizes[] = {64LL * KILOBYTE, 2LL * MEGABYTE, 16LL * MEGABYTE, 128LL * MEGABYTE, 1024LL * MEGABYTE};
+    int numBlockSizes = sizeof(blockSizes) / sizeof(blockSizes[0]);
+
+    struct stat fileStat;
+    if (stat(filename, &fileStat) == -1) {
+        perror("Error getting file information");
+        exit(EXIT_FAILURE);
+    }
+
+    struct LatencyHistogram hist;
+    measureReadTime(filename, 1 * MEGABYTE, fileStat.st_size / MEGABYTE, READ_CACHED, NULL, &hist, NULL);
+
+    printf("\nBlock Size\tPages\tHuge bytes\tMiB/s\t\tdTLB misses/MiB\n");
+
+    for (int i = 0; i < numBlockSizes; ++i) {
+        int block_size = blockSizes[i];
+        int block_count = fileStat.st_size / block_size;
+        if (block_count == 0) {
+            printf("%d\t(skipped, larger than the file)\n", block_size);
+            continue;
+        }
+        double totalDataSizeMB = (double)block_size * block_count / MEGABYTE;
+
+        for (int kind = POOL_PAGES_NORMAL; kind <= POOL_PAGES_HUGETLB; ++kind) {
+            poolSetPages(kind);
+
+            // Acquired and faulted in here, measureReadTime() gets the same buffer back
+            char* buffer = poolAcquire(block_size);
+            int pages = poolBufferPages(buffer);
+            size_t hugeBytes = poolHugeBytes(buffer);
+            poolRelease(buffer);
+
+            int tlb = openTLBCounter();
+            if (tlb != -1) {
+                ioctl(tlb, PERF_EVENT_IOC_RESET, 0);
+                ioctl(tlb, PERF_EVENT_IOC_ENABLE, 0);
+            }
+
+            double totalTime = measureReadTime(filename, block_size, block_count, READ_CACHED, NULL, &hist, NULL);
+
+            long long misses = -1;
+            if (tlb != -1) {
+                ioctl(tlb, PERF_EVENT_IOC_DISABLE, 0);
+                if (read(tlb, &misses, sizeof(misses)) != sizeof(misses)) {
+                    misses = -1;
+                }
+                close(tlb);
+            }
+
+            printf("%d\t%s\t%.1f MiB\t%.2f\t", block_size, poolPagesName(pages), (double)hugeBytes / MEGABYTE,
+                   totalDataSizeMB / totalTime);
+            if (misses >= 0) {
+                printf("\t%.1f\n", misses / totalDataSizeMB);
+            } else {
+                printf("\tn/a\n");
+            }
+        }
+    }
+
+    poolSetPages(POOL_PAGES_NORMAL);
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
+    int opt;
+    while ((opt = getopt(argc, argv, "p:HM:")) != -1) {
+        switch (opt) {
+            case 'p': {
+                int kind = poolParsePages(optarg);
+                if (kind < 0) {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                poolSetPages(kind);
+                break;
+            }
+            case 'H':
+                compareHugePages = 1;
+                break;
+            case 'M':
+                if ((memoryBudget = atol(optarg) * MEGABYTE) <= 0) {
+                    printUsage();
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                printUsage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != 1) {
         printUsage();
         return EXIT_FAILURE;
     }
 
-    const char* filename = argv[1];
+    const char* filename = argv[optind];
+    timingInit();
+    if (memoryBudget > 0) {
+        struct BandwidthPoint points[MEMBW_MAX_POINTS];
+        printMemoryCalibration(points, memoryCalibrate(memoryBudget, points));
+    }
+
     int defaultBlockSize = 512;  // Default block size (adjust as needed)
 
     printf("\nFinding Performance for the Optimal File Size :\n\n");
@@ -115,5 +212,10 @@ int main(int argc, char* argv[]) {
     printf("\nTest case to find the performance for different block sizes in MiB/s:\n");
     runTestCases(filename);
 
+    if (compareHugePages) {
+        printf("\nBuffer page size comparison (cached reads):\n");
+        runHugePageComparison(filename);
+    }
+
     return 0;
 }
@@ -0,0 +1,286 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include "bufpool.h"
+#include "iocore.h"
+#include "pipeline.h"
+#include "timing.h"
+
+void xorBuffer(char* buffer, int size) {
+    for (int i = 0; i < size; ++i) {
+        buffer[i] ^= 0xFF;  // adding a padding with xor to avoid overflows.
+    }
+}
+
+// One preallocated buffer of the pipeline ring. sequence says whose turn it
+// is: position p is free for the reader when sequence == p and full for the
+// workers when sequence == p + 1.
+struct RingSlot {
+    long long sequence;
+    int length;
+    char* buffer;
+};
+
+// Bounded lock-free ring between one reader and several compute workers
+struct PipelineRing {
+    struct RingSlot* slots;
+    int depth;
+    long long consumePosition;  // Next position a worker will claim
+    long long produced;         // Buffers the reader filled, valid once done is set
+    int done;
+};
+
+// Waits for the other side of the ring without holding a CPU it may need
+static void ringPause(void) {
+    sched_yield();
+}
+
+static void* pipelineWorker(void* arg) {
+    struct PipelineRing* ring = (struct PipelineRing*)arg;
+
+    for (;;) {
+        long long position = __atomic_load_n(&ring->consumePosition, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&ring->done, __ATOMIC_ACQUIRE) && position >= ring->produced) {
+            break;
+        }
+
+        struct RingSlot* slot = &ring->slots[position % ring->depth];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != position + 1) {
+            ringPause();
+            continue;
+        }
+        if (!__atomic_compare_exchange_n(&ring->consumePosition, &position, position + 1, 0,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            continue;
+        }
+
+        xorBuffer(slot->buffer, slot->length);
+
+        // Hand the slot back to the reader for its next lap
+        __atomic_store_n(&slot->sequence, position + ring->depth, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+// Reads the whole file into ring buffers of bufferSize bytes on this thread
+// while numWorkers threads run xorBuffer() on the filled ones. Returns
+// wall-clock seconds, or -1 if a cold cache could not be set up.
+double measurePipelineTime(const char* filename, int bufferSize, int depth, int numWorkers, int mode) {
+    if (!prepareCache(filename, mode)) {
+        return -1;
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("Error opening file for reading");
+        exit(EXIT_FAILURE);
+    }
+
+    struct PipelineRing ring;
+    ring.depth = depth;
+    ring.consumePosition = 0;
+    ring.produced = 0;
+    ring.done = 0;
+    ring.slots = malloc(sizeof(struct RingSlot) * depth);
+    pthread_t* workers = malloc(sizeof(pthread_t) * numWorkers);
+    if (ring.slots == NULL || workers == NULL) {
+        perror("Error allocating pipeline");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < depth; ++i) {
+        ring.slots[i].sequence = i;
+        ring.slots[i].length = 0;
+        ring.slots[i].buffer = poolAcquire(bufferSize);
+    }
+
+    double start = timingSeconds();
+
+    for (int i = 0; i < numWorkers; ++i) {
+        if (pthread_create(&workers[i], NULL, pipelineWorker, &ring) != 0) {
+            perror("Error creating thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (long long position = 0;; ++position) {
+        struct RingSlot* slot = &ring.slots[position % depth];
+        while (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != position) {
+            ringPause();
+        }
+
+        ssize_t bytesRead = read(fd, slot->buffer, bufferSize);
+        if (bytesRead == -1) {
+            perror("Error reading from file");
+            exit(EXIT_FAILURE);
+        }
+        if (bytesRead == 0) {
+            ring.produced = position;
+            __atomic_store_n(&ring.done, 1, __ATOMIC_RELEASE);
+            break;
+        }
+
+        slot->length = bytesRead;
+        __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+    }
+
+    for (int i = 0; i < numWorkers; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+
+    double totalTime = timingSeconds() - start;
+
+    for (int i = 0; i < depth; ++i) {
+        poolRelease(ring.slots[i].buffer);
+    }
+    free(ring.slots);
+    free(workers);
+    close(fd);
+
+    return totalTime;
+}
+
+// Reads the whole file in bufferSize chunks, running xorBuffer() on each one
+// right after its read() when compute is set. Returns wall-clock seconds, or
+// -1 if a cold cache could not be set up.
+double measureSerialTime(const char* filename, int bufferSize, int compute, int mode) {
+    if (!prepareCache(filename, mode)) {
+        return -1;
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("Error opening file for reading");
+        exit(EXIT_FAILURE);
+    }
+
+    char* buffer = poolAcquire(bufferSize);
+
+    double start = timingSeconds();
+
+    ssize_t bytesRead;
+    while ((bytesRead = read(fd, buffer, bufferSize)) > 0) {
+        if (compute) {
+            xorBuffer(buffer, bytesRead);
+        }
+    }
+    if (bytesRead == -1) {
+        perror("Error reading from file");
+        exit(EXIT_FAILURE);
+    }
+
+    double totalTime = timingSeconds() - start;
+
+    poolRelease(buffer);
+    close(fd);
+
+    return totalTime;
+}
+
+// Writes a scratch buffer of twice the last level cache so the data touched
+// before is no longer in any CPU cache
+static void evictCpuCaches(void) {
+    long size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (size <= 0) {
+        size = PIPELINE_DEFAULT_L3;
+    }
+
+    char* scratch = poolAcquire(2 * size);
+    memset(scratch, 0x5A, 2 * size);
+    poolRelease(scratch);
+}
+
+// Time xorBuffer() alone takes over size bytes in bufferSize pieces. The data
+// is a buffer as large as the file, up to PIPELINE_COMPUTE_MAX and walked
+// again from the start beyond that, evicted from the CPU caches first so the
+// XOR pays for memory traffic like it does on freshly read data.
+double measureComputeTime(long long size, int bufferSize) {
+    long long span = size < PIPELINE_COMPUTE_MAX ? size : PIPELINE_COMPUTE_MAX;
+    if (span <= 0) {
+        return 0.0;
+    }
+    char* data = poolAcquire(span);
+    memset(data, 0xA5, span);
+    evictCpuCaches();
+
+    double start = timingSeconds();
+    for (long long done = 0; done < size;) {
+        long long offset = done % span;
+        long long length = bufferSize;
+        if (length > span - offset) {
+            length = span - offset;
+        }
+        if (length > size - done) {
+            length = size - done;
+        }
+        xorBuffer(data + offset, length);
+        done += length;
+    }
+    double totalTime = timingSeconds() - start;
+
+    poolRelease(data);
+
+    return totalTime;
+}
+
+int measurePipeline(const char* filename, int bufferSize, int depth, int numWorkers, int mode, struct PipelineRun* run) {
+    run->bufferSize = bufferSize;
+    run->depth = depth;
+    run->numWorkers = numWorkers;
+    run->bytes = fileSize(filename);
+
+    run->readTime = measureSerialTime(filename, bufferSize, 0, mode);
+    run->serialTime = measureSerialTime(filename, bufferSize, 1, mode);
+    run->pipelineTime = measurePipelineTime(filename, bufferSize, depth, numWorkers, mode);
+    run->computeTime = measureComputeTime(run->bytes, bufferSize);
+
+    return run->readTime >= 0 && run->serialTime >= 0 && run->pipelineTime >= 0;
+}
+
+double pipelineIdealTime(const struct PipelineRun* run) {
+    double compute = run->computeTime / run->numWorkers;
+    return run->readTime > compute ? run->readTime : compute;
+}
+
+int pipelineOverlap(const struct PipelineRun* run, double* efficiency) {
+    double ideal = pipelineIdealTime(run);
+    if (run->serialTime <= ideal) {
+        return 0;
+    }
+    *efficiency = (run->serialTime - run->pipelineTime) / (run->serialTime - ideal);
+    return 1;
+}
+
+void printPipeline(const struct PipelineRun* run) {
+    double fileSizeMB = (double)run->bytes / MEGABYTE;
+
+    printf("Ring depth %d, buffer size %d KiB, %d compute worker(s)\n", run->depth, run->bufferSize / KILOBYTE,
+           run->numWorkers);
+    printf("Read only: %.4f seconds, %.2f MiB/s\n", run->readTime, fileSizeMB / run->readTime);
+    printf("Compute only: %.4f seconds, %.2f MiB/s\n", run->computeTime, fileSizeMB / run->computeTime);
+    printf("Serial read+XOR: %.4f seconds, %.2f MiB/s\n", run->serialTime, fileSizeMB / run->serialTime);
+    printf("Pipelined read+XOR: %.4f seconds, %.2f MiB/s (%.2fx serial)\n", run->pipelineTime,
+           fileSizeMB / run->pipelineTime, run->serialTime / run->pipelineTime);
+
+    double overlap;
+    if (pipelineOverlap(run, &overlap)) {
+        printf("Overlap efficiency: %.1f%% (best possible %.4f seconds)\n\n", 100.0 * overlap,
+               pipelineIdealTime(run));
+    } else {
+        printf("Overlap efficiency: n/a, nothing to overlap\n\n");
+    }
+}
+
+void runPipelineTest(const char* filename, int bufferSize, int depth, int numWorkers, int useCache) {
+    struct PipelineRun run;
+    if (!measurePipeline(filename, bufferSize, depth, numWorkers, useCache ? READ_CACHED : READ_COLD, &run)) {
+        printf("Pipeline: not reported, file is not cold\n\n");
+        return;
+    }
+    printPipeline(&run);
+}
@@ -0,0 +1,52 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// Read/compute pipeline. One thread reads the file into a lock-free ring of
+// preallocated buffers while worker threads run xorBuffer() on the filled
+// ones, compared with the serial loop that XORs each buffer right after its
+// read(). Overlap efficiency is the share of the possible saving the
+// pipeline realises: 0% is no better than serial, 100% reaches
+// max(read, compute / workers).
+
+#define PIPELINE_COMPUTE_MAX (256L << 20)  // Largest buffer the compute-only run walks
+#define PIPELINE_DEFAULT_L3 (32L << 20)    // Assumed last level cache when sysconf() does not know
+
+// One comparison: its configuration and wall-clock seconds of every loop
+struct PipelineRun {
+    int bufferSize;
+    int depth;
+    int numWorkers;
+    long long bytes;
+    double readTime;      // Serial loop without the XOR
+    double computeTime;   // XOR alone over data that is not in the CPU caches
+    double serialTime;    // Serial read+XOR
+    double pipelineTime;
+};
+
+void xorBuffer(char* buffer, int size);
+
+// Return -1 when the run cannot be reported (READ_COLD and the file could
+// not be evicted)
+double measurePipelineTime(const char* filename, int bufferSize, int depth, int numWorkers, int mode);
+double measureSerialTime(const char* filename, int bufferSize, int compute, int mode);
+
+double measureComputeTime(long long size, int bufferSize);
+
+// Runs all four loops in read mode READ_CACHED or READ_COLD. Returns 0 when
+// they cannot be reported.
+int measurePipeline(const char* filename, int bufferSize, int depth, int numWorkers, int mode, struct PipelineRun* run);
+
+// Best possible pipeline time, max(read, compute / workers)
+double pipelineIdealTime(const struct PipelineRun* run);
+
+// Stores the overlap efficiency, 1.0 at the ideal time and negative when the
+// pipeline is slower than serial. Returns 0 when the serial loop already
+// reaches the ideal time and there is nothing to overlap.
+int pipelineOverlap(const struct PipelineRun* run, double* efficiency);
+
+void printPipeline(const struct PipelineRun* run);
+
+// Measures and prints one comparison, or why it is not reported
+void runPipelineTest(const char* filename, int bufferSize, int depth, int numWorkers, int useCache);
+
+#endif
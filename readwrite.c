@@ -1,12 +1,21 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 #include <time.h>
+#include "bufpool.h"
+#include "timing.h"
 
 void printUsage() {
-    printf("Usage: ./run <filename> [-r|-w] <block_size> <block_count>\n");
+    printf("Usage: ./run <filename> [-r|-R|-w] <block_size> <block_count>\n");
+    printf("  -r  Copy the file to stdout with sendfile()/splice()\n");
+    printf("  -R  Copy the file to stdout with read()/write()\n");
+    printf("  -w  Write blocks typed on stdin to the file\n");
 }
 
 void clearInputBuffer() {
@@ -14,39 +23,115 @@ void clearInputBuffer() {
     while ((c = getchar()) != '\n' && c != EOF);
 }
 
-void readFile(const char* filename, int block_size, int block_count) {
+// Writes all of buffer, retrying short writes to pipes and sockets
+void writeAll(int fd, const char* buffer, ssize_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, buffer, size);
+        if (written == -1) {
+            perror("Error writing to stdout");
+            exit(EXIT_FAILURE);
+        }
+        buffer += written;
+        size -= written;
+    }
+}
+
+// Moves up to size bytes from the file at *offset to stdout without copying
+// them through user space: splice() when stdout is a pipe, sendfile()
+// otherwise. Returns the bytes moved, 0 at end of file, or -1 with errno set.
+ssize_t transferZeroCopy(int fd, off_t* offset, size_t size, int stdoutIsPipe) {
+    size_t moved = 0;
+    while (moved < size) {
+        ssize_t ret;
+        if (stdoutIsPipe) {
+            ret = splice(fd, offset, STDOUT_FILENO, NULL, size - moved, SPLICE_F_MOVE | SPLICE_F_MORE);
+        } else {
+            ret = sendfile(STDOUT_FILENO, fd, offset, size - moved);
+        }
+        if (ret == -1) {
+            return moved > 0 ? (ssize_t)moved : -1;
+        }
+        if (ret == 0) {
+            break;
+        }
+        moved += ret;
+    }
+    return moved;
+}
+
+// Copies the file to stdout block by block. Unless copy is set, blocks go
+// through sendfile()/splice(); the read()/write() loop takes over if the
+// kernel cannot do that for this stdout. Each sample covers moving one block.
+void readFile(const char* filename, int block_size, int block_count, int copy) {
     int fd = open(filename, O_RDONLY);
     if (fd == -1) {
         perror("Error opening file for reading");
         exit(EXIT_FAILURE);
     }
 
-    char buffer[block_size];
+    struct stat outStat;
+    if (fstat(STDOUT_FILENO, &outStat) == -1) {
+        perror("Error getting stdout information");
+        exit(EXIT_FAILURE);
+    }
+    int stdoutIsPipe = S_ISFIFO(outStat.st_mode);
+
+    char* buffer = poolAcquire(block_size);
     ssize_t bytesRead;
+    long long totalBytes = 0;
+    off_t offset = 0;
+    const char* method = "read/write";
+    if (!copy) {
+        method = stdoutIsPipe ? "splice" : "sendfile";
+    }
 
-    clock_t start, end;
-    double totalTime = 0;
+    struct LatencyHistogram hist;
+    histInit(&hist);
 
     for (int i = 0; i < block_count; ++i) {
-        start = clock();
-
-        bytesRead = read(fd, buffer, block_size);
+        uint64_t start = timingNow();
+
+        if (!copy) {
+            bytesRead = transferZeroCopy(fd, &offset, block_size, stdoutIsPipe);
+            if (bytesRead == -1 && (errno == EINVAL || errno == ENOSYS) && i == 0) {
+                // Nothing sent yet, so the plain loop can start from the beginning
+                fprintf(stderr, "%s to stdout is not supported, falling back to read/write\n", method);
+                copy = 1;
+                method = "read/write";
+                i--;
+                continue;
+            }
+            if (bytesRead == -1) {
+                perror("Error sending file to stdout");
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            bytesRead = read(fd, buffer, block_size);
+            if (bytesRead == -1) {
+                perror("Error reading from file");
+                exit(EXIT_FAILURE);
+            }
+            writeAll(STDOUT_FILENO, buffer, bytesRead);
+        }
 
-        end = clock();
-        double elapsedTime = ((double)(end - start)) / CLOCKS_PER_SEC;
+        uint64_t end = timingNow();
 
-        if (bytesRead == -1) {
-            perror("Error reading from file");
-            exit(EXIT_FAILURE);
+        if (bytesRead == 0) {
+            break;
         }
+        totalBytes += bytesRead;
 
-        totalTime += elapsedTime;
-
-        write(STDOUT_FILENO, buffer, bytesRead);
+        histRecord(&hist, timingElapsed(start, end));
     }
 
-    printf("\nRead %zd characters in total in %.2f seconds\n", (ssize_t) block_count * block_size, totalTime);
+    double totalTime = histSeconds(&hist);
+
+    // Statistics go to stderr so stdout carries only the file contents
+    fprintf(stderr, "\nRead %lld characters in total in %.2f seconds using %s\n", totalBytes, totalTime, method);
+    fprintf(stderr, "Throughput: %.2f MiB/s\n", totalTime > 0 ? (double)totalBytes / (1024 * 1024) / totalTime : 0.0);
+    histFprint(stderr, &hist);
 
+    poolRelease(buffer);
     close(fd);
 }
 
@@ -57,7 +142,7 @@ void writeFile(const char* filename, int block_size, int block_count) {
         exit(EXIT_FAILURE);
     }
 
-    char buffer[block_size];
+    char* buffer = poolAcquire(block_size);
 
     printf("Enter data to write to the file:\n");
     for (int i = 0; i < block_count; ++i) {
@@ -79,6 +164,7 @@ void writeFile(const char* filename, int block_size, int block_count) {
         }
     }
 
+    poolRelease(buffer);
     close(fd);
 }
 
@@ -92,13 +178,16 @@ int main(int argc, char* argv[]) {
     const char* mode = argv[2];
     int block_size = atoi(argv[3]);
     int block_count = atoi(argv[4]);
+    timingInit();
 
     if (strcmp(mode, "-r") == 0) {
-        readFile(filename, block_size, block_count);
+        readFile(filename, block_size, block_count, 0);
+    } else if (strcmp(mode, "-R") == 0) {
+        readFile(filename, block_size, block_count, 1);
     } else if (strcmp(mode, "-w") == 0) {
         writeFile(filename, block_size, block_count);
     } else {
-        fprintf(stderr, "Invalid mode. Use -r for reading or -w for writing.\n");
+        fprintf(stderr, "Invalid mode. Use -r or -R for reading or -w for writing.\n");
         printUsage();
         return EXIT_FAILURE;
     }
@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/utsname.h>
+#include "report.h"
+
+#define MEGABYTE (1024 * 1024)
+
+// Run metadata, collected once in reportBegin()
+struct Metadata {
+    char timestamp[32];
+    char hostname[256];
+    char kernel[256];
+    char machine[128];
+    char cpuModel[256];
+    long cpus;
+    long pageSize;
+    long long memoryBytes;
+    char filesystem[32];
+    const char* file;
+    long long fileSize;
+    char commandLine[1024];
+};
+
+static FILE* reportOut;
+static int reportFormat;
+static int numResults;
+static struct Metadata metadata;
+
+int parseFormat(const char* name) {
+    if (strcmp(name, "text") == 0) {
+        return FORMAT_TEXT;
+    }
+    if (strcmp(name, "json") == 0) {
+        return FORMAT_JSON;
+    }
+    if (strcmp(name, "csv") == 0) {
+        return FORMAT_CSV;
+    }
+    return -1;
+}
+
+void resultInit(struct Result* result, const char* benchmark, const char* engine, const char* mode) {
+    memset(result, 0, sizeof(*result));
+    result->benchmark = benchmark;
+    result->engine = engine;
+    result->mode = mode;
+    result->threads = 1;
+}
+
+void resultAddExtra(struct Result* result, const char* name, double value) {
+    if (result->numExtra == MAX_EXTRA_FIELDS) {
+        fprintf(stderr, "Too many extra fields in result, dropping %s\n", name);
+        return;
+    }
+    result->extraNames[result->numExtra] = name;
+    result->extraValues[result->numExtra] = value;
+    result->numExtra++;
+}
+
+// Adds a 64-bit checksum as checksum_hi and checksum_lo, split in halves so
+// the value survives the trip through a double
+void resultAddChecksum(struct Result* result, uint64_t value) {
+    resultAddExtra(result, "checksum_hi", (double)(value >> 32));
+    resultAddExtra(result, "checksum_lo", (double)(value & 0xffffffffu));
+}
+
+static void readCPUModel(char* model, size_t size) {
+    snprintf(model, size, "unknown");
+
+    FILE* cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (cpuinfo == NULL) {
+        return;
+    }
+
+    char line[512];
+    while (fgets(line, sizeof(line), cpuinfo) != NULL) {
+        if (strncmp(line, "model name", 10) == 0) {
+            char* value = strchr(line, ':');
+            if (value != NULL) {
+                value += 2;
+                value[strcspn(value, "\n")] = '\0';
+                snprintf(model, size, "%s", value);
+            }
+            break;
+        }
+    }
+
+    fclose(cpuinfo);
+}
+
+static void filesystemName(const char* filename, char* name, size_t size) {
+    struct statfs fsStat;
+    if (statfs(filename, &fsStat) == -1) {
+        snprintf(name, size, "unknown");
+        return;
+    }
+
+    switch ((unsigned long)fsStat.f_type) {
+        case 0xEF53: snprintf(name, size, "ext4"); break;
+        case 0x58465342: snprintf(name, size, "xfs"); break;
+        case 0x9123683E: snprintf(name, size, "btrfs"); break;
+        case 0x01021994: snprintf(name, size, "tmpfs"); break;
+        case 0x2FC12FC1: snprintf(name, size, "zfs"); break;
+        case 0x6969: snprintf(name, size, "nfs"); break;
+        case 0x794C7630: snprintf(name, size, "overlayfs"); break;
+        case 0xF2F52010: snprintf(name, size, "f2fs"); break;
+        default: snprintf(name, size, "0x%lx", (unsigned long)fsStat.f_type); break;
+    }
+}
+
+static void collectMetadata(int argc, char* argv[], const char* filename) {
+    memset(&metadata, 0, sizeof(metadata));
+
+    time_t now = time(NULL);
+    strftime(metadata.timestamp, sizeof(metadata.timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    struct utsname host;
+    if (uname(&host) == 0) {
+        snprintf(metadata.hostname, sizeof(metadata.hostname), "%s", host.nodename);
+        snprintf(metadata.kernel, sizeof(metadata.kernel), "%s %s", host.sysname, host.release);
+        snprintf(metadata.machine, sizeof(metadata.machine), "%s", host.machine);
+    }
+
+    readCPUModel(metadata.cpuModel, sizeof(metadata.cpuModel));
+    metadata.cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    metadata.pageSize = sysconf(_SC_PAGESIZE);
+    metadata.memoryBytes = (long long)sysconf(_SC_PHYS_PAGES) * metadata.pageSize;
+
+    metadata.file = filename;
+    filesystemName(filename, metadata.filesystem, sizeof(metadata.filesystem));
+    struct stat fileStat;
+    metadata.fileSize = stat(filename, &fileStat) == 0 ? fileStat.st_size : -1;
+
+    size_t used = 0;
+    for (int i = 0; i < argc && used < sizeof(metadata.commandLine); ++i) {
+        used += snprintf(metadata.commandLine + used, sizeof(metadata.commandLine) - used, "%s%s", i ? " " : "", argv[i]);
+    }
+}
+
+static void printJSONString(const char* value) {
+    fputc('"', reportOut);
+    for (const char* c = value; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(reportOut, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(reportOut, "\\u%04x", *c);
+        } else {
+            fputc(*c, reportOut);
+        }
+    }
+    fputc('"', reportOut);
+}
+
+// CSV fields are quoted only when they contain a separator or a quote
+static void printCSVString(const char* value) {
+    if (strpbrk(value, ",\"\n") == NULL) {
+        fputs(value, reportOut);
+        return;
+    }
+
+    fputc('"', reportOut);
+    for (const char* c = value; *c; ++c) {
+        if (*c == '"') {
+            fputc('"', reportOut);
+        }
+        fputc(*c, reportOut);
+    }
+    fputc('"', reportOut);
+}
+
+void reportBegin(FILE* out, int format, int argc, char* argv[], const char* filename) {
+    reportOut = out;
+    reportFormat = format;
+    numResults = 0;
+    collectMetadata(argc, argv, filename);
+
+    if (reportFormat == FORMAT_JSON) {
+        fprintf(reportOut, "{\n  \"metadata\": {\n");
+        fprintf(reportOut, "    \"timestamp\": "); printJSONString(metadata.timestamp);
+        fprintf(reportOut, ",\n    \"hostname\": "); printJSONString(metadata.hostname);
+        fprintf(reportOut, ",\n    \"kernel\": "); printJSONString(metadata.kernel);
+        fprintf(reportOut, ",\n    \"machine\": "); printJSONString(metadata.machine);
+        fprintf(reportOut, ",\n    \"cpu_model\": "); printJSONString(metadata.cpuModel);
+        fprintf(reportOut, ",\n    \"cpus\": %ld", metadata.cpus);
+        fprintf(reportOut, ",\n    \"page_size\": %ld", metadata.pageSize);
+        fprintf(reportOut, ",\n    \"memory_bytes\": %lld", metadata.memoryBytes);
+        fprintf(reportOut, ",\n    \"file\": "); printJSONString(metadata.file);
+        fprintf(reportOut, ",\n    \"file_size\": %lld", metadata.fileSize);
+        fprintf(reportOut, ",\n    \"filesystem\": "); printJSONString(metadata.filesystem);
+        fprintf(reportOut, ",\n    \"timer\": "); printJSONString(timingSource());
+        fprintf(reportOut, ",\n    \"timer_overhead_ns\": %llu", (unsigned long long)timingOverhead());
+        fprintf(reportOut, ",\n    \"command_line\": "); printJSONString(metadata.commandLine);
+        fprintf(reportOut, "\n  },\n  \"results\": [");
+    } else if (reportFormat == FORMAT_CSV) {
+        fprintf(reportOut, "timestamp,hostname,kernel,cpu_model,cpus,file,file_size,filesystem,timer,"
+                           "benchmark,engine,mode,block_size,threads,bytes,ops,seconds,mib_per_s,iops,"
+                           "lat_min_ns,lat_p50_ns,lat_p90_ns,lat_p99_ns,lat_p999_ns,lat_max_ns,extra\n");
+    } else {
+        fprintf(reportOut, "Host: %s (%s, %s, %ld CPUs)\n", metadata.hostname, metadata.kernel, metadata.cpuModel, metadata.cpus);
+        fprintf(reportOut, "File: %s, %.2f MB on %s\n", metadata.file, (double)metadata.fileSize / MEGABYTE, metadata.filesystem);
+        fprintf(reportOut, "Timer: %s, %llu ns overhead subtracted per sample\n\n", timingSource(), (unsigned long long)timingOverhead());
+    }
+}
+
+static void printJSONResult(const struct Result* result, double mibPerSecond, double iops) {
+    fprintf(reportOut, "%s\n    {\"benchmark\": ", numResults ? "," : "");
+    printJSONString(result->benchmark);
+    fprintf(reportOut, ", \"engine\": ");
+    printJSONString(result->engine);
+    fprintf(reportOut, ", \"mode\": ");
+    printJSONString(result->mode);
+    fprintf(reportOut, ", \"block_size\": %lld, \"threads\": %d, \"bytes\": %lld, \"ops\": %lld, "
+                       "\"seconds\": %.9f, \"mib_per_s\": %.3f, \"iops\": %.1f",
+            result->block_size, result->threads, result->bytes, result->ops, result->seconds, mibPerSecond, iops);
+
+    if (result->latency != NULL && result->latency->count > 0) {
+        const struct LatencyHistogram* hist = result->latency;
+        fprintf(reportOut, ", \"latency_ns\": {\"min\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p99_9\": %llu, \"max\": %llu}",
+                (unsigned long long)hist->min,
+                (unsigned long long)histPercentile(hist, 50.0),
+                (unsigned long long)histPercentile(hist, 90.0),
+                (unsigned long long)histPercentile(hist, 99.0),
+                (unsigned long long)histPercentile(hist, 99.9),
+                (unsigned long long)hist->max);
+    }
+
+    if (result->numExtra > 0) {
+        fprintf(reportOut, ", \"extra\": {");
+        for (int i = 0; i < result->numExtra; ++i) {
+            fprintf(reportOut, "%s", i ? ", " : "");
+            printJSONString(result->extraNames[i]);
+            // JSON has no inf or nan, a ratio over a zero time is reported as null
+            if (isfinite(result->extraValues[i])) {
+                fprintf(reportOut, ": %.17g", result->extraValues[i]);
+            } else {
+                fprintf(reportOut, ": null");
+            }
+        }
+        fprintf(reportOut, "}");
+    }
+
+    fprintf(reportOut, "}");
+}
+
+static void printCSVResult(const struct Result* result, double mibPerSecond, double iops) {
+    const char* strings[] = {metadata.timestamp, metadata.hostname, metadata.kernel, metadata.cpuModel};
+    for (int i = 0; i < 4; ++i) {
+        printCSVString(strings[i]);
+        fputc(',', reportOut);
+    }
+    fprintf(reportOut, "%ld,", metadata.cpus);
+    printCSVString(metadata.file);
+    fprintf(reportOut, ",%lld,%s,%s,", metadata.fileSize, metadata.filesystem, timingSource());
+    fprintf(reportOut, "%s,%s,", result->benchmark, result->engine);
+    printCSVString(result->mode);
+    fprintf(reportOut, ",%lld,%d,%lld,%lld,%.9f,%.3f,%.1f", result->block_size, result->threads,
+            result->bytes, result->ops, result->seconds, mibPerSecond, iops);
+
+    if (result->latency != NULL && result->latency->count > 0) {
+        const struct LatencyHistogram* hist = result->latency;
+        fprintf(reportOut, ",%llu,%llu,%llu,%llu,%llu,%llu",
+                (unsigned long long)hist->min,
+                (unsigned long long)histPercentile(hist, 50.0),
+                (unsigned long long)histPercentile(hist, 90.0),
+                (unsigned long long)histPercentile(hist, 99.0),
+                (unsigned long long)histPercentile(hist, 99.9),
+                (unsigned long long)hist->max);
+    } else {
+        fprintf(reportOut, ",,,,,,");
+    }
+
+    // Benchmark specific values as name=value pairs in one column
+    fputc(',', reportOut);
+    for (int i = 0; i < result->numExtra; ++i) {
+        fprintf(reportOut, "%s%s=%g", i ? ";" : "", result->extraNames[i], result->extraValues[i]);
+    }
+    fputc('\n', reportOut);
+}
+
+static void printTextResult(const struct Result* result, double mibPerSecond, double iops) {
+    fprintf(reportOut, "%s %s %s, Block Size : %lld, Threads: %d: %.2f MiB/s, %.0f IOPS",
+            result->benchmark, result->engine, result->mode, result->block_size, result->threads, mibPerSecond, iops);
+    for (int i = 0; i < result->numExtra; ++i) {
+        fprintf(reportOut, ", %s %g", result->extraNames[i], result->extraValues[i]);
+    }
+    fputc('\n', reportOut);
+
+    if (result->latency != NULL) {
+        histFprint(reportOut, result->latency);
+    }
+}
+
+void reportResult(const struct Result* result) {
+    double mibPerSecond = result->seconds > 0 ? result->bytes / (double)MEGABYTE / result->seconds : 0.0;
+    double iops = result->seconds > 0 ? result->ops / result->seconds : 0.0;
+
+    if (reportFormat == FORMAT_JSON) {
+        printJSONResult(result, mibPerSecond, iops);
+    } else if (reportFormat == FORMAT_CSV) {
+        printCSVResult(result, mibPerSecond, iops);
+    } else {
+        printTextResult(result, mibPerSecond, iops);
+    }
+
+    numResults++;
+    fflush(reportOut);
+}
+
+// Free-form remarks go to the text report, or to stderr so they do not break
+// machine-readable output.
+void reportNote(const char* message) {
+    if (reportFormat == FORMAT_TEXT) {
+        fprintf(reportOut, "%s\n", message);
+    } else {
+        fprintf(stderr, "%s\n", message);
+    }
+}
+
+void reportEnd(void) {
+    if (reportFormat == FORMAT_JSON) {
+        fprintf(reportOut, "\n  ]\n}\n");
+    }
+    fflush(reportOut);
+}
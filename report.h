@@ -0,0 +1,46 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "timing.h"
+
+// Result output for the bench driver. Every run starts with reportBegin(),
+// which records the run metadata, emits one record per reportResult() call
+// and is closed with reportEnd().
+
+#define FORMAT_TEXT 0
+#define FORMAT_JSON 1
+#define FORMAT_CSV 2
+
+#define MAX_EXTRA_FIELDS 16
+
+// One measured configuration. Benchmark specific values that do not fit the
+// common columns go into the extra fields.
+struct Result {
+    const char* benchmark;
+    const char* engine;
+    const char* mode;
+    long long block_size;
+    int threads;
+    long long bytes;
+    long long ops;
+    double seconds;
+    const struct LatencyHistogram* latency;  // NULL when operations were not timed individually
+    int numExtra;
+    const char* extraNames[MAX_EXTRA_FIELDS];
+    double extraValues[MAX_EXTRA_FIELDS];
+};
+
+int parseFormat(const char* name);
+
+void resultInit(struct Result* result, const char* benchmark, const char* engine, const char* mode);
+void resultAddExtra(struct Result* result, const char* name, double value);
+void resultAddChecksum(struct Result* result, uint64_t value);
+
+void reportBegin(FILE* out, int format, int argc, char* argv[], const char* filename);
+void reportResult(const struct Result* result);
+void reportNote(const char* message);
+void reportEnd(void);
+
+#endif
@@ -0,0 +1,103 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "iocore.h"
+#include "membw.h"
+#include "sweep.h"
+#include "timing.h"
+
+void printFileSize(int block_size, int block_count) {
+    double fileSizeKB = (double)block_size * block_count / KILOBYTE;
+    double fileSizeMB = fileSizeKB / KILOBYTE;
+
+    printf("Block Size : %d , Block count: %d blocks, %.2f KB, %.2f MB\n", block_size, block_count, fileSizeKB, fileSizeMB);
+}
+
+void printPerformance(const char* filename, int block_size, int block_count, int useCache) {
+    struct LatencyHistogram hist;
+    double totalTime = measureReadTime(filename, block_size, block_count, useCache ? READ_CACHED : READ_COLD, NULL,
+                                       &hist, NULL);
+    if (totalTime < 0) {
+        printf("Performance: not reported, file is not cold\n");
+        return;
+    }
+
+    // Calculate performance in MiB/s
+    double totalDataSizeMB = (double)block_size * block_count / MEGABYTE;
+    double performance = totalDataSizeMB / totalTime;
+
+    printf("Time taken to read (%s): %.2f seconds\n", (useCache ? "Cached" : "Non-cached"), totalTime);
+    printf("Performance: %.2f MiB/s\n", performance);
+    printMemoryFraction(performance, 1);
+    histPrint(&hist);
+}
+
+void runTestCases(const char* filename, int useCache) {
+    if (useCache) {
+        printf("\nBlock Size\tCached Performance (MiB/s)\n\n");
+    } else {
+        printf("\nBlock Size\tNon-cached Performance (MiB/s)\n\n");
+    }
+
+    long long size = fileSize(filename);
+
+    for (int i = 0; i < numDefaultBlockSizes; ++i) {
+        int block_size = defaultBlockSizes[i];
+        int block_count = size / block_size;
+
+        // Perform test case
+        printFileSize(block_size, block_count);
+        printPerformance(filename, block_size, block_count, useCache);
+        printf("\n\n");
+    }
+}
+
+void runDirectTestCases(const char* filename) {
+    int memAlign, offsetAlign;
+    if (!directIOAlignment(filename, &memAlign, &offsetAlign)) {
+        printf("Direct I/O is not supported on the filesystem holding %s\n", filename);
+        return;
+    }
+
+    printf("\nDirect I/O alignment: memory %d bytes, offset and size %d bytes\n", memAlign, offsetAlign);
+
+    // Report the sizes from the sweep that O_DIRECT rejects before measuring
+    printf("Illegal under O_DIRECT:");
+    int numIllegal = 0;
+    for (int i = 0; i < numDefaultBlockSizes; ++i) {
+        if (defaultBlockSizes[i] % offsetAlign != 0) {
+            printf(" %d", defaultBlockSizes[i]);
+            numIllegal++;
+        }
+    }
+    printf("%s\n", numIllegal ? " (rounded up below)" : " none");
+
+    printf("\nBlock Size\tDirect I/O Performance (MiB/s)\n\n");
+
+    long long size = fileSize(filename);
+
+    for (int i = 0; i < numDefaultBlockSizes; ++i) {
+        int block_size = roundToAlignment(defaultBlockSizes[i], offsetAlign);
+        int block_count = size / block_size;
+
+        if (block_size != defaultBlockSizes[i]) {
+            printf("Requested Block Size %d rounded to %d\n", defaultBlockSizes[i], block_size);
+        }
+        printFileSize(block_size, block_count);
+
+        struct LatencyHistogram hist;
+        double totalTime = measureReadTime(filename, block_size, block_count, READ_DIRECT, NULL, &hist, NULL);
+        if (totalTime < 0) {
+            return;
+        }
+
+        double totalDataSizeMB = (double)block_size * block_count / MEGABYTE;
+        double performance = totalDataSizeMB / totalTime;
+
+        printf("Time taken to read (Direct): %.2f seconds\n", totalTime);
+        printf("Performance: %.2f MiB/s, %.0f IOPS\n", performance, block_count / totalTime);
+        printMemoryFraction(performance, 1);
+        histPrint(&hist);
+        printf("\n\n");
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+// Block-size sweeps shared by caching and fast. Each one reads the whole file
+// once per size in defaultBlockSizes through measureReadTime() and prints
+// throughput, the share of the memory bandwidth (membw.h) and the latency
+// histogram of every size.
+
+void printFileSize(int block_size, int block_count);
+
+// Reads the file once in READ_CACHED or READ_COLD mode
+void printPerformance(const char* filename, int block_size, int block_count, int useCache);
+void runTestCases(const char* filename, int useCache);
+
+// O_DIRECT sweep. Sizes the filesystem rejects are listed first and then
+// rounded up to its alignment.
+void runDirectTestCases(const char* filename);
+
+#endif
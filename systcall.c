@@ -1,53 +1,20 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <time.h>
-
-#define KILOBYTE 1024
-#define MEGABYTE (KILOBYTE * KILOBYTE)
+#include "iocore.h"
+#include "timing.h"
 
 void printUsage() {
-    printf("Usage: ./systcall <filename>\n");
-}
-
-double measureReadTime(const char* filename, int block_size, int block_count) {
-    int fd = open(filename, O_RDONLY);
-    if (fd == -1) {
-        perror("Error opening file for reading");
-        exit(EXIT_FAILURE);
-    }
-
-    char buffer[block_size];
-    ssize_t bytesRead;
-
-    clock_t start, end;
-    double totalTime = 0;
-
-    for (int i = 0; i < block_count; ++i) {
-        start = clock();
-
-        bytesRead = read(fd, buffer, block_size);
-
-        end = clock();
-        double elapsedTime = ((double)(end - start)) / CLOCKS_PER_SEC;
-
-        if (bytesRead == -1) {
-            perror("Error reading from file");
-            exit(EXIT_FAILURE);
-        }
-
-        totalTime += elapsedTime;
-    }
-
-    close(fd);
-
-    return totalTime;
+    printf("Usage: ./systcall [-n iterations] <filename>\n");
 }
 
 void printFileSize(int block_size, int block_count) {
@@ -58,7 +25,8 @@ void printFileSize(int block_size, int block_count) {
 }
 
 void printPerformance(const char* filename, int block_size, int block_count) {
-    double totalTime = measureReadTime(filename, block_size, block_count);
+    struct LatencyHistogram hist;
+    double totalTime = measureReadTime(filename, block_size, block_count, READ_CACHED, NULL, &hist, NULL);
 
     // Calculate performance in MiB/s and B/s
     double totalDataSizeMB = (double)block_size * block_count / MEGABYTE;
@@ -68,162 +36,242 @@ void printPerformance(const char* filename, int block_size, int block_count) {
     printf("Time taken to read: %.6f seconds\n", totalTime);
     printf("Performance: %.2f MiB/s\n", performanceMBs);
     printf("Performance: %.2f B/s\n", performanceBs);
+    histPrint(&hist);
 }
 
-void measureSystemCallPerformance(const char* filename) {
-    printf("\nSystem Call Performance Measurement:\n");
-    printf("\n");
-
-    // File descriptor for the file
-    int fd = open(filename, O_RDONLY);
-    if (fd == -1) {
-        perror("Error opening file for system call measurement");
-        exit(EXIT_FAILURE);
-    }
-
-    // Measure write system call performance
-    struct timeval start, end;
-    gettimeofday(&start, NULL);
-
-    // Writing a small buffer to the file
-    char buffer[512];
-    write(fd, buffer, sizeof(buffer));
-
-    gettimeofday(&end, NULL);
-
-    double elapsedTime = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
-
-    // Calculate performance in MiB/s and B/s
-    double totalDataSizeMB = (double)512 / MEGABYTE; // Assuming a small buffer of 512 bytes for system calls
-    double performanceMBs = totalDataSizeMB / elapsedTime;
-    double performanceBs = 512 / elapsedTime;
+#define DEFAULT_ITERATIONS 1000000
+#define DISK_ITERATIONS 1000     // Calls that wait for the disk are far slower
+#define WARMUP_ITERATIONS 10000
+#define DISK_WARMUP_ITERATIONS 10  // A handful is enough to fault in the paths of a disk wait
+#define BATCH_SIZE 64            // Calls per timed batch of the mean for the cheap calls
+
+struct SyscallTest {
+    const char* name;
+    const char* entry;  // How the call reaches the kernel: vDSO, libc wrapper or raw syscall()
+    void (*call)(void);
+    int waitsForDisk;
+};
+
+int testFd;
+int scratchFd;
+char scratchBuffer[512];
+
+// Calls through the same pointer as the tests, so the loop and call cost can be subtracted
+void callNothing(void) {
+    __asm__ volatile("" ::: "memory");
+}
 
-    printf("System Call: write\n");
-    printf("Time taken: %.6f seconds\n", elapsedTime);
-    printf("Performance: %.2f MiB/s\n", performanceMBs);
-    printf("Performance: %.2f B/s\n", performanceBs);
-    printf("\n");
+void callGetpid(void) {
+    getpid();
+}
 
-    // Perform fdatasync system call and measure its performance
-    gettimeofday(&start, NULL);
-    fdatasync(fd);
-    gettimeofday(&end, NULL);
+void callGetpidRaw(void) {
+    syscall(SYS_getpid);
+}
 
-    elapsedTime = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+void callGetppid(void) {
+    getppid();
+}
 
-    // Calculate performance in MiB/s and B/s
-    totalDataSizeMB = (double)512 / MEGABYTE; // Assuming a small buffer of 512 bytes for system calls
-    performanceMBs = totalDataSizeMB / elapsedTime;
-    performanceBs = 512 / elapsedTime;
+void callClockGettime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+}
 
-    printf("System Call: fdatasync\n");
-    printf("Time taken: %.6f seconds\n", elapsedTime);
-    printf("Performance: %.2f MiB/s\n", performanceMBs);
-    printf("Performance: %.2f B/s\n", performanceBs);
-    printf("\n");
+void callClockGettimeRaw(void) {
+    struct timespec ts;
+    syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+}
 
-    // Perform fsync system call and measure its performance
-    gettimeofday(&start, NULL);
-    fsync(fd);
-    gettimeofday(&end, NULL);
+void callGettimeofday(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+}
 
-    elapsedTime = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+void callGettimeofdayRaw(void) {
+    struct timeval tv;
+    syscall(SYS_gettimeofday, &tv, NULL);
+}
 
-    // Calculate performance in MiB/s and B/s
-    totalDataSizeMB = (double)512 / MEGABYTE; // Assuming a small buffer of 512 bytes for system calls
-    performanceMBs = totalDataSizeMB / elapsedTime;
-    performanceBs = 512 / elapsedTime;
+void callFstat(void) {
+    struct stat fileStat;
+    fstat(testFd, &fileStat);
+}
 
-    printf("System Call: fsync\n");
-    printf("Time taken: %.6f seconds\n", elapsedTime);
-    printf("Performance: %.2f MiB/s\n", performanceMBs);
-    printf("Performance: %.2f B/s\n", performanceBs);
-    printf("\n");
+void callLseek(void) {
+    lseek(testFd, 0, SEEK_CUR);
+}
 
-    // Perform fstat system call and measure its performance
-    struct stat fileStat;
-    gettimeofday(&start, NULL);
-    fstat(fd, &fileStat);
-    gettimeofday(&end, NULL);
+void callPread(void) {
+    char byte;
+    pread(testFd, &byte, 1, 0);
+}
 
-    elapsedTime = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+void callPwrite(void) {
+    if (pwrite(scratchFd, scratchBuffer, sizeof(scratchBuffer), 0) == -1) {
+        perror("Error writing scratch file");
+        exit(EXIT_FAILURE);
+    }
+}
 
-    // Calculate performance in MiB/s and B/s
-    totalDataSizeMB = (double)512 / MEGABYTE; // Assuming a small buffer of 512 bytes for system calls
-    performanceMBs = totalDataSizeMB / elapsedTime;
-    performanceBs = 512 / elapsedTime;
+// fdatasync() of a clean file returns without I/O, so every call dirties a block first
+void callPwriteFdatasync(void) {
+    callPwrite();
+    fdatasync(scratchFd);
+}
 
-    printf("System Call: fstat\n");
-    printf("Time taken: %.6f seconds\n", elapsedTime);
-    printf("Performance: %.2f MiB/s\n", performanceMBs);
-    printf("Performance: %.2f B/s\n", performanceBs);
-    printf("\n");
+void callPwriteFsync(void) {
+    callPwrite();
+    fsync(scratchFd);
+}
 
-    // Perform lseek system call and measure its performance
-    gettimeofday(&start, NULL);
-    lseek(fd, 0, SEEK_SET);
-    gettimeofday(&end, NULL);
+const struct SyscallTest syscallTests[] = {
+    {"getpid", "libc", callGetpid, 0},
+    {"getpid", "syscall", callGetpidRaw, 0},
+    {"getppid", "libc", callGetppid, 0},
+    {"clock_gettime", "vDSO", callClockGettime, 0},
+    {"clock_gettime", "syscall", callClockGettimeRaw, 0},
+    {"gettimeofday", "vDSO", callGettimeofday, 0},
+    {"gettimeofday", "syscall", callGettimeofdayRaw, 0},
+    {"fstat", "libc", callFstat, 0},
+    {"lseek", "libc", callLseek, 0},
+    {"pread 1 B", "libc", callPread, 0},
+    {"pwrite 512 B", "libc", callPwrite, 0},
+    {"pwrite+fdatasync", "libc", callPwriteFdatasync, 1},
+    {"pwrite+fsync", "libc", callPwriteFsync, 1},
+};
+const int numSyscallTests = sizeof(syscallTests) / sizeof(syscallTests[0]);
+
+// Times iterations calls in batches of batchSize and returns the mean ns per
+// call minus baseline. Batching amortises the clock reads for the mean.
+double measureCallMean(void (*call)(void), long long iterations, int batchSize, double baseline) {
+    double total = 0.0;
+    long long numBatches = iterations / batchSize;
+
+    for (long long b = 0; b < numBatches; ++b) {
+        uint64_t start = timingNow();
+        for (int i = 0; i < batchSize; ++i) {
+            call();
+        }
+        uint64_t elapsed = timingElapsed(start, timingNow());
 
-    elapsedTime = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+        double perCall = (double)elapsed / batchSize - baseline;
+        total += perCall < 0 ? 0 : perCall;
+    }
 
-    // Calculate performance in MiB/s and B/s
-    totalDataSizeMB = (double)512 / MEGABYTE; // Assuming a small buffer of 512 bytes for system calls
-    performanceMBs = totalDataSizeMB / elapsedTime;
-    performanceBs = 512 / elapsedTime;
+    return total / numBatches;
+}
 
-    printf("System Call: lseek\n");
-    printf("Time taken: %.6f seconds\n", elapsedTime);
-    printf("Performance: %.2f MiB/s\n", performanceMBs);
-    printf("Performance: %.2f B/s\n", performanceBs);
-    printf("\n");
+// Times each of iterations calls on its own and records it in hist, minus
+// baseline ns. Returns the mean ns per call.
+double measureCallSamples(void (*call)(void), long long iterations, double baseline, struct LatencyHistogram* hist) {
+    histInit(hist);
+    double total = 0.0;
 
-    // Perform getpid system call and measure its performance
-    gettimeofday(&start, NULL);
-    getpid();
-    gettimeofday(&end, NULL);
+    for (long long i = 0; i < iterations; ++i) {
+        uint64_t start = timingNow();
+        call();
+        uint64_t elapsed = timingElapsed(start, timingNow());
 
-    elapsedTime = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+        double sample = (double)elapsed - baseline;
+        if (sample < 0) {
+            sample = 0;
+        }
+        total += sample;
+        histRecord(hist, (uint64_t)(sample + 0.5));
+    }
 
-    // Calculate performance in MiB/s and B/s
-    totalDataSizeMB = (double)512 / MEGABYTE; // Assuming a small buffer of 512 bytes for system calls
-    performanceMBs = totalDataSizeMB / elapsedTime;
-    performanceBs = 512 / elapsedTime;
+    return total / iterations;
+}
 
-    printf("System Call: getpid\n");
-    printf("Time taken: %.6f seconds\n", elapsedTime);
-    printf("Performance: %.2f MiB/s\n", performanceMBs);
-    printf("Performance: %.2f B/s\n", performanceBs);
-    printf("\n");
+// Makes warmup untimed calls, records iterations individually timed calls
+// in hist and returns the mean ns per call, from batches of batchSize when
+// batchSize is above 1. The baselines are the loop cost per call of each way
+// of timing.
+double measureCall(void (*call)(void), int warmup, long long iterations, int batchSize, double batchBaseline,
+                   double singleBaseline, struct LatencyHistogram* hist) {
+    for (int i = 0; i < warmup; ++i) {
+        call();
+    }
 
-    // Perform getppid system call and measure its performance
-    gettimeofday(&start, NULL);
-    getppid();
-    gettimeofday(&end, NULL);
+    double mean = measureCallSamples(call, iterations, singleBaseline, hist);
+    if (batchSize > 1) {
+        mean = measureCallMean(call, iterations, batchSize, batchBaseline);
+    }
+    return mean;
+}
 
-    elapsedTime = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+void measureSystemCallPerformance(const char* filename, long long iterations) {
+    printf("\nSystem Call Performance Measurement:\n");
+    printf("Timer: %s, %llu ns overhead subtracted per sample\n",
+           timingSource(), (unsigned long long)timingOverhead());
 
-    // Calculate performance in MiB/s and B/s
-    totalDataSizeMB = (double)512 / MEGABYTE; // Assuming a small buffer of 512 bytes for system calls
-    performanceMBs = totalDataSizeMB / elapsedTime;
-    performanceBs = 512 / elapsedTime;
+    testFd = open(filename, O_RDONLY);
+    if (testFd == -1) {
+        perror("Error opening file for system call measurement");
+        exit(EXIT_FAILURE);
+    }
 
-    printf("System Call: getppid\n");
-    printf("Time taken: %.6f seconds\n", elapsedTime);
-    printf("Performance: %.2f MiB/s\n", performanceMBs);
-    printf("Performance: %.2f B/s\n", performanceBs);
-    printf("\n");
+    // Writes go to a scratch file next to the test file, never to the test file itself
+    char scratchName[4096];
+    snprintf(scratchName, sizeof(scratchName), "%s.syscall-scratch", filename);
+    scratchFd = open(scratchName, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (scratchFd == -1) {
+        perror("Error creating scratch file");
+        exit(EXIT_FAILURE);
+    }
+    memset(scratchBuffer, 0xa5, sizeof(scratchBuffer));
+
+    // Loop and indirect call cost of an empty call, per call
+    struct LatencyHistogram hist;
+    double loopSingle = measureCall(callNothing, WARMUP_ITERATIONS, iterations, 1, 0.0, 0.0, &hist);
+    double loopBatched = measureCallMean(callNothing, iterations, BATCH_SIZE, 0.0);
+    printf("Loop overhead: %.2f ns/call batched, %.2f ns/call single (subtracted)\n\n", loopBatched, loopSingle);
+
+    printf("%-18s %-8s %10s %10s %10s %10s %10s %12s\n",
+           "Call", "Entry", "ns/op", "p50", "p90", "p99", "p99.9", "Calls");
+
+    for (int t = 0; t < numSyscallTests; ++t) {
+        const struct SyscallTest* test = &syscallTests[t];
+        long long calls = test->waitsForDisk ? DISK_ITERATIONS : iterations;
+        int batchSize = test->waitsForDisk ? 1 : BATCH_SIZE;
+        int warmup = test->waitsForDisk ? DISK_WARMUP_ITERATIONS : WARMUP_ITERATIONS;
+
+        double mean = measureCall(test->call, warmup, calls, batchSize, loopBatched, loopSingle, &hist);
+
+        printf("%-18s %-8s %10.1f %10llu %10llu %10llu %10llu %12llu\n",
+               test->name, test->entry, mean,
+               (unsigned long long)histPercentile(&hist, 50.0),
+               (unsigned long long)histPercentile(&hist, 90.0),
+               (unsigned long long)histPercentile(&hist, 99.0),
+               (unsigned long long)histPercentile(&hist, 99.9),
+               (unsigned long long)hist.count);
+    }
 
-    // Close the file descriptor
-    close(fd);
+    close(scratchFd);
+    unlink(scratchName);
+    close(testFd);
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
+    long long iterations = DEFAULT_ITERATIONS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt != 'n' || (iterations = atoll(optarg)) < BATCH_SIZE) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != 1) {
         printUsage();
         return EXIT_FAILURE;
     }
 
-    const char* filename = argv[1];
+    const char* filename = argv[optind];
+    timingInit();
+
     int blockSize = 1;  // Block size set to 1 byte
     int blockCount;  // Number of blocks set to the file size in bytes
 
@@ -237,7 +285,7 @@ int main(int argc, char* argv[]) {
     blockCount = fileStat.st_size;
     
     // Measure system call performance
-    measureSystemCallPerformance(filename);
+    measureSystemCallPerformance(filename, iterations);
     printf("\n");
     printf("\nFinding Performance for 1 Byte Block Size:\n");
     
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "timing.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(TIMING_NO_TSC)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#define CALIBRATION_NS 20000000ULL  // How long the TSC is compared against the monotonic clock
+#define OVERHEAD_SAMPLES 100000
+
+static int useTSC = 0;
+static double nsPerCycle = 0.0;
+static uint64_t tscBase = 0;
+static uint64_t monotonicBase = 0;
+static uint64_t overhead = 0;
+
+static uint64_t monotonicNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#ifdef HAVE_TSC
+// An invariant TSC ticks at a constant rate in every P- and C-state
+static int invariantTSC(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    return (edx >> 8) & 1;
+}
+#endif
+
+uint64_t timingNow(void) {
+#ifdef HAVE_TSC
+    if (useTSC) {
+        unsigned int aux;
+        return monotonicBase + (uint64_t)((__rdtscp(&aux) - tscBase) * nsPerCycle);
+    }
+#endif
+    return monotonicNow();
+}
+
+double timingSeconds(void) {
+    return timingNow() / 1e9;
+}
+
+void timingInit(void) {
+#ifdef HAVE_TSC
+    if (invariantTSC()) {
+        unsigned int aux;
+        uint64_t startNs = monotonicNow();
+        uint64_t startTsc = __rdtscp(&aux);
+        uint64_t endNs;
+
+        while ((endNs = monotonicNow()) - startNs < CALIBRATION_NS) {
+        }
+        uint64_t endTsc = __rdtscp(&aux);
+
+        nsPerCycle = (double)(endNs - startNs) / (endTsc - startTsc);
+        tscBase = endTsc;
+        monotonicBase = endNs;
+        useTSC = 1;
+    }
+#endif
+
+    // The cheapest back-to-back reading is the fixed cost inside every sample
+    overhead = UINT64_MAX;
+    for (int i = 0; i < OVERHEAD_SAMPLES; ++i) {
+        uint64_t start = timingNow();
+        uint64_t end = timingNow();
+        if (end - start < overhead) {
+            overhead = end - start;
+        }
+    }
+}
+
+uint64_t timingOverhead(void) {
+    return overhead;
+}
+
+const char* timingSource(void) {
+    return useTSC ? "TSC" : "CLOCK_MONOTONIC";
+}
+
+uint64_t timingElapsed(uint64_t start, uint64_t end) {
+    uint64_t elapsed = end > start ? end - start : 0;
+    return elapsed > overhead ? elapsed - overhead : 0;
+}
+
+void histInit(struct LatencyHistogram* hist) {
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+static int histIndex(uint64_t ns) {
+    if (ns < 2 * HIST_SUB_COUNT) {
+        return ns;
+    }
+
+    int shift = 63 - __builtin_clzll(ns) - HIST_SUB_BITS;
+    return shift * HIST_SUB_COUNT + (int)(ns >> shift);
+}
+
+// Largest value that falls into a bucket
+static uint64_t histBucketValue(int index) {
+    if (index < 2 * HIST_SUB_COUNT) {
+        return index;
+    }
+
+    int shift = index / HIST_SUB_COUNT - 1;
+    uint64_t top = index - shift * HIST_SUB_COUNT;
+    return ((top + 1) << shift) - 1;
+}
+
+void histRecord(struct LatencyHistogram* hist, uint64_t ns) {
+    hist->buckets[histIndex(ns)]++;
+    hist->count++;
+    hist->total += ns;
+    if (ns < hist->min) {
+        hist->min = ns;
+    }
+    if (ns > hist->max) {
+        hist->max = ns;
+    }
+}
+
+void histMerge(struct LatencyHistogram* dst, const struct LatencyHistogram* src) {
+    for (int i = 0; i < HIST_NUM_BUCKETS; ++i) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->total += src->total;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+uint64_t histPercentile(const struct LatencyHistogram* hist, double percentile) {
+    if (hist->count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * hist->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_NUM_BUCKETS; ++i) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint64_t value = histBucketValue(i);
+            if (value < hist->min) {
+                return hist->min;
+            }
+            return value < hist->max ? value : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+// Sum of all recorded samples in seconds
+double histSeconds(const struct LatencyHistogram* hist) {
+    return hist->total / 1e9;
+}
+
+void histPrint(const struct LatencyHistogram* hist) {
+    histFprint(stdout, hist);
+}
+
+void histFprint(FILE* out, const struct LatencyHistogram* hist) {
+    if (hist->count == 0) {
+        fprintf(out, "Latency: no operations recorded\n");
+        return;
+    }
+
+    fprintf(out, "Latency (us): min %.2f, p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, max %.2f (%llu ops)\n",
+            hist->min / 1e3,
+            histPercentile(hist, 50.0) / 1e3,
+            histPercentile(hist, 90.0) / 1e3,
+            histPercentile(hist, 99.0) / 1e3,
+            histPercentile(hist, 99.9) / 1e3,
+            hist->max / 1e3,
+            (unsigned long long)hist->count);
+}
@@ -0,0 +1,43 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Shared timing for the benchmarks. Timestamps come from the TSC when the CPU
+// has an invariant one and from CLOCK_MONOTONIC otherwise; both are reported
+// in nanoseconds. timingInit() must run once before the first measurement.
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_NUM_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+// Log-linear latency histogram: values below 2 * HIST_SUB_COUNT ns are exact,
+// larger values land in one of HIST_SUB_COUNT buckets per power of two
+// (about 3% relative error).
+struct LatencyHistogram {
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[HIST_NUM_BUCKETS];
+};
+
+void timingInit(void);
+uint64_t timingNow(void);
+double timingSeconds(void);
+uint64_t timingOverhead(void);
+const char* timingSource(void);
+
+// Nanoseconds between two timingNow() readings, minus the timer overhead
+uint64_t timingElapsed(uint64_t start, uint64_t end);
+
+void histInit(struct LatencyHistogram* hist);
+void histRecord(struct LatencyHistogram* hist, uint64_t ns);
+void histMerge(struct LatencyHistogram* dst, const struct LatencyHistogram* src);
+uint64_t histPercentile(const struct LatencyHistogram* hist, double percentile);
+double histSeconds(const struct LatencyHistogram* hist);
+void histPrint(const struct LatencyHistogram* hist);
+void histFprint(FILE* out, const struct LatencyHistogram* hist);
+
+#endif